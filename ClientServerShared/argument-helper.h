@@ -13,12 +13,14 @@
 #ifndef argument_helper_h
 #define argument_helper_h
 
+#include <cstring>
 #include <iostream>
 #include <regex>
 #include <string>
 #include <unordered_map>
 
 #include <dirent.h>
+#include <sys/un.h>
 
 namespace EmersonClientServerFileSystem
 {
@@ -30,6 +32,8 @@ namespace EmersonClientServerFileSystem
         
         static const char * server_directory_arg_prefix = "--server_directory=";
         
+        static const char * server_unix_path_arg_prefix = "--server_unix_path=";
+        
         static const char * help_arg_prefix = "--help";
         
         static const char * argument_indent = "  ";
@@ -91,6 +95,10 @@ namespace EmersonClientServerFileSystem
             
             std::cout << description_indent << "The path to the directory where the server is writing files. This\n" << description_indent << "argument can be used when the client and server are running on the\n" << description_indent << "same machine to enable deletion of test created files." << std::endl;
             
+            std::cout << argument_indent << server_unix_path_arg_prefix << "[SOCKET_PATH]" << std::endl;
+            
+            std::cout << description_indent << "The path of the Unix domain socket the server is listening on. This\n" << description_indent << "argument enables the tests that run over the Unix domain socket\n" << description_indent << "transport." << std::endl;
+            
             std::cout << std::endl;
         }
         
@@ -113,6 +121,14 @@ namespace EmersonClientServerFileSystem
             std::cout << description_indent << "The path to the directory where the server is to write files." << std::endl;
             
             std::cout << std::endl;
+            
+            std::cout << "Optional Arguments:" << std::endl;
+            
+            std::cout << argument_indent << server_unix_path_arg_prefix << "[SOCKET_PATH]" << std::endl;
+            
+            std::cout << description_indent << "The path of a Unix domain socket the server is to listen on in\n" << description_indent << "addition to the IPv4 address and port, for clients running on the\n" << description_indent << "same machine. An existing socket at the path is replaced." << std::endl;
+            
+            std::cout << std::endl;
         }
         
         static inline void validateDirectory(std::string& in_directory)
@@ -184,6 +200,23 @@ namespace EmersonClientServerFileSystem
                 exit(EXIT_FAILURE);
             }
         }
+        
+        static inline void validateUnixPath(const std::string& in_unix_path)
+        {
+            if (in_unix_path.empty())
+            {
+                std::cerr << "Error no server unix path provided. Please provide a server unix path by passing " << server_unix_path_arg_prefix << "<server_unix_path> as a command line argument." << std::endl;
+                
+                exit(EXIT_FAILURE);
+            }
+            
+            if (!(in_unix_path.size() < sizeof(sockaddr_un::sun_path))) // leave room for null terminator
+            {
+                std::cerr << "Error unix path \"" << in_unix_path << "\" is too long. Please provide a path shorter than " << sizeof(sockaddr_un::sun_path) << " characters." << std::endl;
+                
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 }
 
@@ -0,0 +1,358 @@
+//
+//  binary-protocol.h
+//  ClientServerShared
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The BinaryHeaderCodec class encodes and decodes the fixed length binary headers of version 2   //
+// of the wire protocol. It provides the same interface as HeaderCodec, so a WireProtocol can be  //
+// built from a pair of BinaryHeaderSchemas in the same way as from a pair of HeaderSchemas.      //
+//                                                                                                //
+// Note: Commands are sent as a single byte holding their index in the schema's CommandTable plus //
+//       one. Integer and UnsignedInteger fields are sent as 32 bit little-endian integers. A     //
+//       request header is therefore 13 bytes and a response header 17 bytes, rather than the 64  //
+//       and 128 bytes of the text protocol.                                                      //
+//                                                                                                //
+// Note: Every connection starts in the text protocol. A client opts into another version by      //
+//       sending a ProtocolPreface before its first request, and the server replies with a        //
+//       preface holding the version it accepted. A preface starts with a null character, which   //
+//       no text header can, so text clients are unaffected and both share the same port.         //
+//                                                                                                //
+// Note: A binary client may also ask for a multiplexed connection in the flags of its preface.   //
+//       Each header is then preceded by a CorrelationId so responses can be matched to their     //
+//       requests whatever order they are sent in.                                                //
+//                                                                                                //
+// Note: A binary client may also ask for its payloads to be compressed with one of the           //
+//       PayloadCodec codecs in its preface (see payload-codec.h), and for them to carry a        //
+//       checksum (see crc32c.h).                                                                 //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef binary_protocol_h
+#define binary_protocol_h
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "wire-protocol.h"
+
+namespace EmersonClientServerFileSystem
+{
+    // every integer of the binary protocol is sent as 32 bits in little-endian byte order
+    namespace LittleEndian
+    {
+        static inline uint32_t load32(const char * in_p)
+        {
+            auto p = reinterpret_cast<const unsigned char *>(in_p);
+            
+            return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+        }
+        
+        static inline void store32(char * out_p, uint32_t in_value)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                out_p[i] = static_cast<char>(in_value >> (8 * i) & 0xFF);
+            }
+        }
+    }
+    
+    // Note: CommandTable must have a static constexpr array of command names, s_commands. Its
+    //       order fixes the command codes so commands may only ever be appended to it.
+    template<class CommandTable, FieldType... Fields>
+    struct BinaryHeaderSchema
+    {
+        static constexpr size_t s_num_fields = sizeof...(Fields);
+        
+        static constexpr FieldType s_field_types[] = {Fields...};
+        
+        static constexpr size_t s_header_len = ((FieldType::Command == Fields ? 1 : 4) + ...);
+        
+        static constexpr const auto& s_commands = CommandTable::s_commands;
+        
+        static constexpr size_t s_num_commands = sizeof(CommandTable::s_commands) / sizeof(CommandTable::s_commands[0]);
+        
+        static_assert(s_num_commands < 256, "command codes must fit in a single byte");
+    };
+    
+    template<class Schema>
+    class BinaryHeaderCodec
+    {
+        
+    private:
+        
+        using string_view = std::string_view;
+        
+        template<size_t... Is>
+        using index_sequence = std::index_sequence<Is...>;
+        
+        static constexpr size_t s_num_fields = Schema::s_num_fields;
+        
+        static constexpr size_t fieldWidth(FieldType in_field_type)
+        {
+            return FieldType::Command == in_field_type ? 1 : 4;
+        }
+        
+        static constexpr size_t fieldOffset(size_t in_field)
+        {
+            size_t offset = 0;
+            
+            for (size_t i = 0; i < in_field; ++i)
+            {
+                offset += fieldWidth(Schema::s_field_types[i]);
+            }
+            
+            return offset;
+        }
+        
+        // returns true if in_value can be represented by Target
+        template<class Target, class T>
+        static constexpr bool fitsIn(T in_value)
+        {
+            if constexpr (std::is_signed_v<T>)
+            {
+                if (in_value < 0)
+                {
+                    return std::is_signed_v<Target> && static_cast<intmax_t>(std::numeric_limits<Target>::min()) <= static_cast<intmax_t>(in_value);
+                }
+            }
+            
+            return static_cast<uintmax_t>(in_value) <= static_cast<uintmax_t>(std::numeric_limits<Target>::max());
+        }
+        
+        // returns the code of in_command, or 0 if it is not in the command table
+        static uint8_t getCommandCode(string_view in_command)
+        {
+            for (size_t i = 0; i < Schema::s_num_commands; ++i)
+            {
+                if (in_command == Schema::s_commands[i])
+                {
+                    return static_cast<uint8_t>(i + 1);
+                }
+            }
+            
+            return 0;
+        }
+        
+        static bool isValidCommandCode(uint8_t in_code)
+        {
+            return 0 < in_code && in_code <= Schema::s_num_commands;
+        }
+        
+        template<size_t I, class T>
+        static bool decodeField(const char * in_header, T& out_value)
+        {
+            const char * p = in_header + fieldOffset(I);
+            
+            if constexpr (FieldType::Command == Schema::s_field_types[I])
+            {
+                uint8_t code = static_cast<uint8_t>(*p);
+                
+                if (!isValidCommandCode(code))
+                {
+                    return false;
+                }
+                
+                out_value = T(Schema::s_commands[code - 1]);
+                
+                return true;
+            }
+            else
+            {
+                using Wire = std::conditional_t<FieldType::Integer == Schema::s_field_types[I], int32_t, uint32_t>;
+                
+                Wire value = static_cast<Wire>(LittleEndian::load32(p));
+                
+                if (!fitsIn<T>(value))
+                {
+                    return false;
+                }
+                
+                out_value = static_cast<T>(value);
+                
+                return true;
+            }
+        }
+        
+        template<class MessageTuple, size_t... Is>
+        static bool decodeFields(const char * in_header, MessageTuple& out_message, index_sequence<Is...>)
+        {
+            return (decodeField<Is>(in_header, std::get<Is>(out_message)) && ...);
+        }
+        
+        template<size_t I, class T>
+        static bool encodeField(char * out_header, const T& in_value)
+        {
+            char * p = out_header + fieldOffset(I);
+            
+            if constexpr (FieldType::Command == Schema::s_field_types[I])
+            {
+                uint8_t code = getCommandCode(string_view(in_value));
+                
+                *p = static_cast<char>(code);
+                
+                return isValidCommandCode(code);
+            }
+            else
+            {
+                static_assert(std::is_integral_v<T>, "numeric fields must be encoded from integers");
+                
+                using Wire = std::conditional_t<FieldType::Integer == Schema::s_field_types[I], int32_t, uint32_t>;
+                
+                if (!fitsIn<Wire>(in_value))
+                {
+                    return false;
+                }
+                
+                LittleEndian::store32(p, static_cast<uint32_t>(static_cast<Wire>(in_value)));
+                
+                return true;
+            }
+        }
+        
+        template<size_t... Is, class... Values>
+        static bool encodeFields(char * out_header, index_sequence<Is...>, const Values&... in_values)
+        {
+            return (encodeField<Is>(out_header, in_values) && ...);
+        }
+        
+        template<size_t... Is>
+        static bool areValidCommands(const char * in_header, index_sequence<Is...>)
+        {
+            return ((!(FieldType::Command == Schema::s_field_types[Is]) || isValidCommandCode(static_cast<uint8_t>(in_header[fieldOffset(Is)]))) && ...);
+        }
+        
+    public:
+        
+        // Note: Unlike a text header, a binary header is not null terminated and any
+        //       Schema::s_header_len bytes holding valid command codes form a valid header.
+        static bool isValid(const char * in_header)
+        {
+            assert(!(nullptr == in_header));
+            
+            return areValidCommands(in_header, std::make_index_sequence<s_num_fields>());
+        }
+        
+        // returns false, leaving out_message partially assigned, if in_header holds an unknown
+        // command code or a numeric field that does not fit in its tuple element, otherwise
+        // every element of out_message but the last (the payload) is assigned
+        template<class MessageTuple>
+        static bool decode(const char * in_header, MessageTuple& out_message)
+        {
+            static_assert(s_num_fields + 1 == std::tuple_size<MessageTuple>::value, "MessageTuple must hold every field and the payload");
+            
+            assert(!(nullptr == in_header));
+            
+            return decodeFields(in_header, out_message, std::make_index_sequence<s_num_fields>());
+        }
+        
+        // writes exactly Schema::s_header_len bytes to out_header and returns false if a command
+        // is not in the command table or a value does not fit in 32 bits
+        template<class... Values>
+        static bool encode(char * out_header, const Values&... in_values)
+        {
+            static_assert(s_num_fields == sizeof...(Values), "a value must be given for every field");
+            
+            assert(!(nullptr == out_header));
+            
+            return encodeFields(out_header, std::make_index_sequence<s_num_fields>(), in_values...);
+        }
+        
+    };
+    
+    namespace ProtocolPreface
+    {
+        // magic (4 bytes), version (1 byte), flags (1 byte), codec (1 byte), reserved (1 byte, zero)
+        static constexpr size_t s_preface_len = 8;
+        
+        static constexpr char s_magic[] = {'\0', 'C', 'S', 'F'};
+        
+        // Note: Flags are only accepted with the binary protocol version. The server replies with
+        //       the flags it accepted, which may be fewer than those requested.
+        static constexpr int s_multiplexed_flag = 0x1; // every header is preceded by a CorrelationId
+        
+        static constexpr int s_checksum_flag = 0x2; // every payload is preceded by its Crc32c checksum
+        
+        static constexpr int s_nack_flag = 0x4; // the ACK to a WRITE lists sequence numbers it found missing
+        
+        // Note: The codec is one of the PayloadCodec ids and, like flags, is only accepted with the
+        //       binary protocol version. The server replies with s_none if it does not support the
+        //       requested codec.
+        
+        // writes exactly s_preface_len bytes to out_preface
+        static inline void encode(char * out_preface, int in_version, int in_flags, int in_codec = 0)
+        {
+            assert(!(nullptr == out_preface));
+            
+            memcpy(out_preface, s_magic, sizeof(s_magic));
+            
+            out_preface[4] = static_cast<char>(in_version);
+            
+            out_preface[5] = static_cast<char>(in_flags);
+            
+            out_preface[6] = static_cast<char>(in_codec);
+            
+            out_preface[7] = '\0';
+        }
+        
+        // returns s_preface_len and sets out_version, out_flags and out_codec if in_data starts
+        // with a preface, 0 if it does not, or -1 if the in_len bytes received so far are too few
+        // to tell
+        static inline int decode(const char * in_data, size_t in_len, int& out_version, int& out_flags, int& out_codec)
+        {
+            assert(!(nullptr == in_data));
+            
+            if (!(0 == memcmp(in_data, s_magic, in_len < sizeof(s_magic) ? in_len : sizeof(s_magic))))
+            {
+                return 0;
+            }
+            
+            if (in_len < s_preface_len)
+            {
+                return -1;
+            }
+            
+            out_version = static_cast<unsigned char>(in_data[4]);
+            
+            out_flags = static_cast<unsigned char>(in_data[5]);
+            
+            out_codec = static_cast<unsigned char>(in_data[6]);
+            
+            return static_cast<int>(s_preface_len);
+        }
+    }
+    
+    // Note: On a multiplexed connection every request header is preceded by a 32 bit
+    //       little-endian correlation id chosen by the client, and the response to it is preceded
+    //       by the same id. Requests may then be processed concurrently and their responses sent
+    //       in the order they complete.
+    namespace CorrelationId
+    {
+        static constexpr size_t s_correlation_id_len = 4;
+        
+        // writes exactly s_correlation_id_len bytes to out_data
+        static inline void encode(char * out_data, uint32_t in_correlation_id)
+        {
+            assert(!(nullptr == out_data));
+            
+            LittleEndian::store32(out_data, in_correlation_id);
+        }
+        
+        static inline uint32_t decode(const char * in_data)
+        {
+            assert(!(nullptr == in_data));
+            
+            return LittleEndian::load32(in_data);
+        }
+    }
+}
+
+#endif /* binary_protocol_h */
@@ -9,6 +9,9 @@
 #ifndef constants_h
 #define constants_h
 
+#include <string>
+
+#include "binary-protocol.h"
 #include "wire-protocol.h"
 
 namespace EmersonClientServerFileSystem
@@ -21,12 +24,32 @@ namespace EmersonClientServerFileSystem
         
         static const int server_backlog = 1'000;
         
-        static const int max_sockfd = 255;
+        static const int max_connections = 50'000;
+        
+        static const int event_loops = 0; // 0 runs one listening socket and event loop per core
+        
+        static const int worker_threads = 0; // 0 sizes the worker pool to the number of cores
+        
+        static const int backend_shards = 0; // 0 partitions transaction state into one shard per core
         
         static const time_t connection_timeout_seconds = 10;
         
+        static const bool use_io_uring = true; // falls back to blocking I/O where unsupported
+        
         static const time_t transaction_timeout_seconds = 15;
         
+        static const int group_commit_window_microseconds = 200; // how long a log flush waits for concurrent commits to join it
+        
+        static const size_t group_commit_max_bytes = 64 << 10; // a log flush starts early once its records reach this size
+        
+        static const int max_seq_num = 1 << 20; // higher sequence numbers are rejected as each transaction buffers up to its highest
+        
+        static const int max_content_len = 64 << 20; // requests with longer payloads are rejected before they are buffered
+        
+        static const int timer_tick_milliseconds = 100; // granularity of connection and transaction timeouts
+        
+        static const int timer_wheel_slots = 512; // timers further than a turn of the wheel ahead wait out whole turns
+        
         // ↑                                                                                    ↑ //
         // Server Configuration                                                                   //
         ////////////////////////////////////////////////////////////////////////////////////////////
@@ -58,6 +81,8 @@ namespace EmersonClientServerFileSystem
         
         static const std::string request_format = std::string("^(?=.{") + std::to_string(request_header_len) + std::string("}$)[A-Z_]+[") + delimiting_character + std::string("][-]?[0-9]+[") + delimiting_character + std::string("][-]?[0-9]+[") + delimiting_character + std::string("][0-9]+([") + delimiting_character + std::string("]") + padding_character + std::string("*)?");
         
+        using RequestSchema = HeaderSchema<request_header_len, delimiting_character, padding_character, FieldType::Command, FieldType::Integer, FieldType::Integer, FieldType::UnsignedInteger>;
+        
         // Response Format: COMMAND TXN_ID SEQ_NUM ERROR_CODE CONTENT_LEN DATA
 
         // ^(?=.{<response_header_len>}$)[A-Z_]+[<delimiting_character>][-]?[0-9]+
@@ -66,7 +91,11 @@ namespace EmersonClientServerFileSystem
         
         static const std::string response_format = std::string("^(?=.{") + std::to_string(response_header_len) + std::string("}$)[A-Z_]+[") + delimiting_character + std::string("][-]?[0-9]+[") + delimiting_character + std::string("][-]?[0-9]+[") + delimiting_character + std::string("][0-9]+[") + delimiting_character + std::string("][0-9]+([") + delimiting_character + std::string("]") + padding_character + std::string("*)?");
         
-        static const WireProtocol wire_protocol(request_format.c_str(), response_format.c_str());
+        using ResponseSchema = HeaderSchema<response_header_len, delimiting_character, padding_character, FieldType::Command, FieldType::Integer, FieldType::Integer, FieldType::UnsignedInteger, FieldType::UnsignedInteger>;
+        
+        // Note: wire_protocol accepts exactly the headers matched by request_format and
+        //       response_format without evaluating either regex.
+        static const WireProtocol<RequestSchema, ResponseSchema> wire_protocol{};
         
         // ↑                                                                                    ↑ //
         // Message Format                                                                         //
@@ -76,15 +105,19 @@ namespace EmersonClientServerFileSystem
         // Client Commands                                                                        //
         // ↓                                                                                    ↓ //
         
-        static const char * abort_cmd = "ABORT";
+        static constexpr const char * abort_cmd = "ABORT";
+        
+        static constexpr const char * commit_cmd = "COMMIT";
+        
+        static constexpr const char * new_txn_cmd = "NEW_TXN";
         
-        static const char * commit_cmd = "COMMIT";
+        static constexpr const char * put_cmd = "PUT"; // payload is the file name, a null character, then the contents
         
-        static const char * new_txn_cmd = "NEW_TXN";
+        static constexpr const char * read_cmd = "READ";
         
-        static const char * read_cmd = "READ";
+        static constexpr const char * write_cmd = "WRITE";
         
-        static const char * write_cmd = "WRITE";
+        static constexpr const char * write_batch_cmd = "WRITE_BATCH"; // payload encoded as in write-batch.h
         
         // ↑                                                                                    ↑ //
         // Client Commands                                                                        //
@@ -94,15 +127,58 @@ namespace EmersonClientServerFileSystem
         // Server Commands                                                                        //
         // ↓                                                                                    ↓ //
         
-        static const char * ack_cmd = "ACK";
+        static constexpr const char * ack_cmd = "ACK";
         
-        static const char * ask_resend_cmd = "ASK_RESEND";
+        static constexpr const char * ask_resend_cmd = "ASK_RESEND";
         
-        static const char * error_cmd = "ERROR";
+        static constexpr const char * error_cmd = "ERROR";
         
         // ↑                                                                                    ↑ //
         // Server Commands                                                                        //
         ////////////////////////////////////////////////////////////////////////////////////////////
+        
+        ////////////////////////////////////////////////////////////////////////////////////////////
+        // Binary Protocol                                                                        //
+        // ↓                                                                                    ↓ //
+        
+        static const int text_protocol_version = 1;
+        
+        static const int binary_protocol_version = 2;
+        
+        // Note: The index of a command (plus one) is its code in binary headers, so commands must
+        //       only ever be appended.
+        struct CommandTable
+        {
+            static constexpr const char * s_commands[] = {abort_cmd, commit_cmd, new_txn_cmd, read_cmd, write_cmd, ack_cmd, ask_resend_cmd, error_cmd, write_batch_cmd, put_cmd};
+        };
+        
+        // Request Format: COMMAND (1 byte) TXN_ID (4 bytes) SEQ_NUM (4 bytes) CONTENT_LEN (4 bytes) DATA
+        using BinaryRequestSchema = BinaryHeaderSchema<CommandTable, FieldType::Command, FieldType::Integer, FieldType::Integer, FieldType::UnsignedInteger>;
+        
+        // Response Format: COMMAND (1 byte) TXN_ID (4 bytes) SEQ_NUM (4 bytes) ERROR_CODE (4 bytes) CONTENT_LEN (4 bytes) DATA
+        using BinaryResponseSchema = BinaryHeaderSchema<CommandTable, FieldType::Command, FieldType::Integer, FieldType::Integer, FieldType::UnsignedInteger, FieldType::UnsignedInteger>;
+        
+        static const WireProtocol<BinaryRequestSchema, BinaryResponseSchema, BinaryHeaderCodec> binary_wire_protocol{};
+        
+        // ↑                                                                                    ↑ //
+        // Binary Protocol                                                                        //
+        ////////////////////////////////////////////////////////////////////////////////////////////
+        
+        ////////////////////////////////////////////////////////////////////////////////////////////
+        // Payload Compression                                                                    //
+        // ↓                                                                                    ↓ //
+        
+        static const size_t compression_threshold = 512; // shorter payloads are never compressed
+        
+        static const int lz4_acceleration = 1; // higher is faster but compresses less
+        
+        static const int zstd_compression_level = 3; // 1 (fastest) to 19 (smallest)
+        
+        static const size_t max_decompressed_len = 64 << 20; // longer payloads are rejected
+        
+        // ↑                                                                                    ↑ //
+        // Payload Compression                                                                    //
+        ////////////////////////////////////////////////////////////////////////////////////////////
     }
 }
 
@@ -0,0 +1,233 @@
+//
+//  crc32c.h
+//  ClientServerShared
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The Crc32c functions compute the CRC-32C (Castagnoli) checksum of a payload. A connection that //
+// negotiated ProtocolPreface::s_checksum_flag precedes every payload that is not empty, in       //
+// either direction, with the 32 bit little-endian checksum of the payload as it was before it    //
+// was framed by its PayloadCodec, and the receiver rejects any payload that does not match it.   //
+//                                                                                                //
+// Note: The checksum is computed with the SSE4.2 crc32 instruction on x86-64 processors that    //
+//       have it, chosen when first used, and with slice-by-8 tables elsewhere. The instruction  //
+//       is compiled in for that one function, so no -msse4.2 is needed. The instruction takes   //
+//       several cycles to produce each result but can start a new one every cycle, so large      //
+//       payloads are split into three stripes whose checksums are computed together and then    //
+//       combined.                                                                                //
+//                                                                                                //
+// Note: combine returns the checksum of two concatenated payloads from their checksums, so the   //
+//       checksum of a file can be extended with that of the data appended to it.                 //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef crc32c_h
+#define crc32c_h
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "binary-protocol.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_HARDWARE_SUPPORTED 1
+#include <nmmintrin.h>
+#endif
+
+namespace EmersonClientServerFileSystem
+{
+    namespace Crc32c
+    {
+        // CHECKSUM (4 bytes)
+        static constexpr size_t s_checksum_len = 4;
+        
+        static constexpr uint32_t s_polynomial = 0x82F63B78; // reflected
+        
+        using Table = std::array<uint32_t, 256>;
+        
+        // Note: Table k holds the checksum register after the byte n is followed by k zero bytes,
+        //       so slice-by-8 looks up each of eight bytes in its own table at once.
+        static constexpr std::array<Table, 8> makeTables()
+        {
+            std::array<Table, 8> tables{};
+            
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t crc = n;
+                
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    crc = crc & 1 ? (crc >> 1) ^ s_polynomial : crc >> 1;
+                }
+                
+                tables[0][n] = crc;
+            }
+            
+            for (size_t k = 1; k < tables.size(); ++k)
+            {
+                for (uint32_t n = 0; n < 256; ++n)
+                {
+                    tables[k][n] = (tables[k - 1][n] >> 8) ^ tables[0][tables[k - 1][n] & 0xFF];
+                }
+            }
+            
+            return tables;
+        }
+        
+        static constexpr std::array<Table, 8> s_tables = makeTables();
+        
+        // returns in_a * in_b modulo the polynomial, both being reflected polynomials
+        static constexpr uint32_t multiplyModP(uint32_t in_a, uint32_t in_b)
+        {
+            uint32_t product = 0;
+            
+            for (uint32_t m = uint32_t(1) << 31; m; m >>= 1)
+            {
+                if (in_a & m)
+                {
+                    product ^= in_b;
+                }
+                
+                in_b = in_b & 1 ? (in_b >> 1) ^ s_polynomial : in_b >> 1;
+            }
+            
+            return product;
+        }
+        
+        // returns x^(8 * in_len) modulo the polynomial, the factor that shifts a checksum register
+        // past in_len zero bytes
+        static constexpr uint32_t zeroBytesOperator(size_t in_len)
+        {
+            uint32_t x_pow_2_pow_k = uint32_t(1) << 23; // x^8
+            
+            uint32_t result = uint32_t(1) << 31; // x^0
+            
+            for (; in_len; in_len >>= 1)
+            {
+                if (in_len & 1)
+                {
+                    result = multiplyModP(x_pow_2_pow_k, result);
+                }
+                
+                x_pow_2_pow_k = multiplyModP(x_pow_2_pow_k, x_pow_2_pow_k);
+            }
+            
+            return result;
+        }
+        
+        // returns the register after in_len bytes from in_data, without the initial and final
+        // inversions of the checksum
+        static inline uint32_t extendScalar(uint32_t in_register, const char * in_data, size_t in_len)
+        {
+            const auto& t = s_tables;
+            
+            for (; in_len >= 8; in_data += 8, in_len -= 8)
+            {
+                uint32_t lo = LittleEndian::load32(in_data) ^ in_register, hi = LittleEndian::load32(in_data + 4);
+                
+                in_register = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+            }
+            
+            for (; in_len; ++in_data, --in_len)
+            {
+                in_register = (in_register >> 8) ^ t[0][(in_register ^ static_cast<unsigned char>(*in_data)) & 0xFF];
+            }
+            
+            return in_register;
+        }
+        
+#ifdef CRC32C_HARDWARE_SUPPORTED
+        static constexpr size_t s_stripe_len = 4096;
+        
+        static constexpr uint32_t s_stripe_operator = zeroBytesOperator(s_stripe_len);
+        
+        static constexpr uint32_t s_two_stripes_operator = zeroBytesOperator(2 * s_stripe_len);
+        
+        static inline uint64_t load64(const char * in_data)
+        {
+            uint64_t word;
+            
+            memcpy(&word, in_data, sizeof(word));
+            
+            return word;
+        }
+        
+        __attribute__((target("sse4.2"))) static inline uint32_t extendHardware(uint32_t in_register, const char * in_data, size_t in_len)
+        {
+            uint64_t r0 = in_register;
+            
+            // Note: Each stripe is checksummed from a zero register, which can be combined with the
+            //       register of the stripes before it by shifting that register past the stripe.
+            for (; in_len >= 3 * s_stripe_len; in_data += 3 * s_stripe_len, in_len -= 3 * s_stripe_len)
+            {
+                uint64_t r1 = 0, r2 = 0;
+                
+                for (size_t i = 0; i < s_stripe_len; i += 8)
+                {
+                    r0 = _mm_crc32_u64(r0, load64(in_data + i));
+                    
+                    r1 = _mm_crc32_u64(r1, load64(in_data + s_stripe_len + i));
+                    
+                    r2 = _mm_crc32_u64(r2, load64(in_data + 2 * s_stripe_len + i));
+                }
+                
+                r0 = multiplyModP(s_two_stripes_operator, static_cast<uint32_t>(r0)) ^ multiplyModP(s_stripe_operator, static_cast<uint32_t>(r1)) ^ r2;
+            }
+            
+            for (; in_len >= 8; in_data += 8, in_len -= 8)
+            {
+                r0 = _mm_crc32_u64(r0, load64(in_data));
+            }
+            
+            uint32_t r = static_cast<uint32_t>(r0);
+            
+            for (; in_len; ++in_data, --in_len)
+            {
+                r = _mm_crc32_u8(r, static_cast<unsigned char>(*in_data));
+            }
+            
+            return r;
+        }
+#endif
+        
+        // returns true if compute uses the crc32 instruction on this processor
+        static inline bool isHardwareAccelerated()
+        {
+#if defined(CRC32C_HARDWARE_SUPPORTED) && defined(__SSE4_2__)
+            return true;
+#elif defined(CRC32C_HARDWARE_SUPPORTED)
+            static const bool s_sse4_2 = __builtin_cpu_supports("sse4.2");
+            
+            return s_sse4_2;
+#else
+            return false;
+#endif
+        }
+        
+        // returns the checksum of in_data, or of the data before it followed by in_data if in_crc
+        // is the checksum of the data before it
+        static inline uint32_t compute(std::string_view in_data, uint32_t in_crc = 0)
+        {
+#ifdef CRC32C_HARDWARE_SUPPORTED
+            if (isHardwareAccelerated())
+            {
+                return ~extendHardware(~in_crc, in_data.data(), in_data.length());
+            }
+#endif
+            return ~extendScalar(~in_crc, in_data.data(), in_data.length());
+        }
+        
+        // returns the checksum of the data checksummed by in_crc1 followed by the in_len2 bytes
+        // checksummed by in_crc2
+        static inline uint32_t combine(uint32_t in_crc1, uint32_t in_crc2, size_t in_len2)
+        {
+            return multiplyModP(zeroBytesOperator(in_len2), in_crc1) ^ in_crc2;
+        }
+    }
+}
+
+#endif /* crc32c_h */
@@ -26,6 +26,8 @@ namespace EmersonClientServerFileSystem
         
         static ErrorMapIterator nil = end(messages);
         
+        static const std::string no_message;
+        
         static ErrorMapIterator InvalidMessageFormat = messages.emplace(199, "InvalidMessageFormat").first;
         
         static ErrorMapIterator InvalidCommand = messages.emplace(200, "InvalidCommand").first;
@@ -54,14 +56,19 @@ namespace EmersonClientServerFileSystem
         
         static ErrorMapIterator TransactionAborted = messages.emplace(212, "TransactionAborted").first;
         
+        static ErrorMapIterator ChecksumMismatch = messages.emplace(213, "ChecksumMismatch").first;
+        
+        static ErrorMapIterator SequenceNumberOutOfRange = messages.emplace(214, "SequenceNumberOutOfRange").first;
+        
         static inline int getErrorCode(const ErrorMapIterator& it)
         {
             return it == nil ? 0 : it->first;
         }
         
-        static inline std::string getErrorMessage(const ErrorMapIterator& it)
+        // returns a reference into messages so the message is not copied until it is needed
+        static inline const std::string& getErrorMessage(const ErrorMapIterator& it)
         {
-            return it == nil ? "" : it->second;
+            return it == nil ? no_message : it->second;
         }
     }
 }
@@ -0,0 +1,207 @@
+//
+//  header-classifier.h
+//  ClientServerShared
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The HeaderClassifier functions are used to classify every character of a fixed length header   //
+// at once, producing a bitmask per character class (command characters, digits, minus signs,     //
+// delimiters, and padding). WireProtocol validates and splits headers with bitwise operations on //
+// these masks rather than examining the header one character at a time.                          //
+//                                                                                                //
+// Note: Classification uses AVX2 when compiled with it enabled (e.g. -mavx2), SSE2 on any other  //
+//       x86-64 build, and a scalar loop elsewhere. Each vector of characters is classified with  //
+//       a handful of compares and one movemask per class, so a 64 byte request header takes two  //
+//       (AVX2) or four (SSE2) iterations.                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef header_classifier_h
+#define header_classifier_h
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace EmersonClientServerFileSystem
+{
+    namespace HeaderClassifier
+    {
+        // Note: Bit i of a mask (bit i % 64 of word i / 64) is set if character i of the header
+        //       belongs to the class.
+        template<size_t HeaderLen>
+        struct HeaderMasks
+        {
+            static constexpr size_t s_num_words = (HeaderLen + 63) / 64;
+            
+            uint64_t m_command[s_num_words]; // [A-Z_]
+            uint64_t m_digit[s_num_words]; // [0-9]
+            uint64_t m_minus[s_num_words];
+            uint64_t m_delimiting[s_num_words];
+            uint64_t m_padding[s_num_words];
+            
+            static bool isSet(const uint64_t * in_mask, size_t in_pos)
+            {
+                return in_mask[in_pos / 64] >> (in_pos % 64) & 1;
+            }
+            
+            // returns true if bits [in_begin, in_end) are all set
+            static bool allSet(const uint64_t * in_mask, size_t in_begin, size_t in_end)
+            {
+                assert(in_begin <= in_end && in_end <= HeaderLen);
+                
+                for (size_t pos = in_begin; pos < in_end; )
+                {
+                    size_t word = pos / 64;
+                    
+                    size_t word_end = (word + 1) * 64 < in_end ? (word + 1) * 64 : in_end;
+                    
+                    size_t num_bits = word_end - pos;
+                    
+                    uint64_t range = (64 == num_bits ? ~uint64_t(0) : (uint64_t(1) << num_bits) - 1) << (pos % 64);
+                    
+                    if (!((in_mask[word] & range) == range))
+                    {
+                        return false;
+                    }
+                    
+                    pos = word_end;
+                }
+                
+                return true;
+            }
+            
+            // returns the position of the first set bit at or after in_begin, or HeaderLen if
+            // there is none
+            static size_t findNext(const uint64_t * in_mask, size_t in_begin)
+            {
+                for (size_t word = in_begin / 64; word < s_num_words; ++word)
+                {
+                    uint64_t bits = in_mask[word];
+                    
+                    if (word == in_begin / 64)
+                    {
+                        bits &= ~uint64_t(0) << (in_begin % 64);
+                    }
+                    
+                    if (bits)
+                    {
+                        size_t pos = word * 64 + __builtin_ctzll(bits);
+                        
+                        return pos < HeaderLen ? pos : HeaderLen;
+                    }
+                }
+                
+                return HeaderLen;
+            }
+        };
+        
+        static constexpr bool isCommandCharacter(char in_c)
+        {
+            return ('A' <= in_c && in_c <= 'Z') || '_' == in_c;
+        }
+        
+        static constexpr bool isDigit(char in_c)
+        {
+            return '0' <= in_c && in_c <= '9';
+        }
+        
+        // classifies characters [in_begin, HeaderLen) one at a time
+        template<size_t HeaderLen>
+        static inline void classifyScalar(const char * in_header, char in_delimiting_character, char in_padding_character, HeaderMasks<HeaderLen>& out_masks, size_t in_begin = 0)
+        {
+            for (size_t i = in_begin; i < HeaderLen; ++i)
+            {
+                uint64_t bit = uint64_t(1) << (i % 64);
+                
+                char c = in_header[i];
+                
+                out_masks.m_command[i / 64] |= isCommandCharacter(c) ? bit : 0;
+                
+                out_masks.m_digit[i / 64] |= isDigit(c) ? bit : 0;
+                
+                out_masks.m_minus[i / 64] |= '-' == c ? bit : 0;
+                
+                out_masks.m_delimiting[i / 64] |= in_delimiting_character == c ? bit : 0;
+                
+                out_masks.m_padding[i / 64] |= in_padding_character == c ? bit : 0;
+            }
+        }
+        
+        // Note: in_header must hold at least HeaderLen characters, none past HeaderLen are read.
+        template<size_t HeaderLen>
+        static inline void classify(const char * in_header, char in_delimiting_character, char in_padding_character, HeaderMasks<HeaderLen>& out_masks)
+        {
+            assert(!(nullptr == in_header));
+            
+            out_masks = HeaderMasks<HeaderLen>{};
+            
+            size_t i = 0;
+            
+#if defined(__AVX2__)
+            // Note: Unsigned range checks use x == max(x, lo) && x == min(x, hi) as there is no
+            //       unsigned byte compare.
+            const __m256i upper_lo = _mm256_set1_epi8('A'), upper_hi = _mm256_set1_epi8('Z'), digit_lo = _mm256_set1_epi8('0'), digit_hi = _mm256_set1_epi8('9');
+            
+            const __m256i underscore = _mm256_set1_epi8('_'), minus = _mm256_set1_epi8('-'), delimiting = _mm256_set1_epi8(in_delimiting_character), padding = _mm256_set1_epi8(in_padding_character);
+            
+            for (; i + 32 <= HeaderLen; i += 32)
+            {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in_header + i));
+                
+                __m256i upper = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, upper_lo), x), _mm256_cmpeq_epi8(_mm256_min_epu8(x, upper_hi), x));
+                
+                __m256i digit = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, digit_lo), x), _mm256_cmpeq_epi8(_mm256_min_epu8(x, digit_hi), x));
+                
+                int shift = i % 64;
+                
+                out_masks.m_command[i / 64] |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(upper, _mm256_cmpeq_epi8(x, underscore))))) << shift;
+                
+                out_masks.m_digit[i / 64] |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(digit))) << shift;
+                
+                out_masks.m_minus[i / 64] |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, minus)))) << shift;
+                
+                out_masks.m_delimiting[i / 64] |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, delimiting)))) << shift;
+                
+                out_masks.m_padding[i / 64] |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, padding)))) << shift;
+            }
+#elif defined(__SSE2__)
+            // Note: Unsigned range checks use x == max(x, lo) && x == min(x, hi) as there is no
+            //       unsigned byte compare.
+            const __m128i upper_lo = _mm_set1_epi8('A'), upper_hi = _mm_set1_epi8('Z'), digit_lo = _mm_set1_epi8('0'), digit_hi = _mm_set1_epi8('9');
+            
+            const __m128i underscore = _mm_set1_epi8('_'), minus = _mm_set1_epi8('-'), delimiting = _mm_set1_epi8(in_delimiting_character), padding = _mm_set1_epi8(in_padding_character);
+            
+            for (; i + 16 <= HeaderLen; i += 16)
+            {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in_header + i));
+                
+                __m128i upper = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, upper_lo), x), _mm_cmpeq_epi8(_mm_min_epu8(x, upper_hi), x));
+                
+                __m128i digit = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, digit_lo), x), _mm_cmpeq_epi8(_mm_min_epu8(x, digit_hi), x));
+                
+                int shift = i % 64;
+                
+                out_masks.m_command[i / 64] |= uint64_t(_mm_movemask_epi8(_mm_or_si128(upper, _mm_cmpeq_epi8(x, underscore)))) << shift;
+                
+                out_masks.m_digit[i / 64] |= uint64_t(_mm_movemask_epi8(digit)) << shift;
+                
+                out_masks.m_minus[i / 64] |= uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(x, minus))) << shift;
+                
+                out_masks.m_delimiting[i / 64] |= uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(x, delimiting))) << shift;
+                
+                out_masks.m_padding[i / 64] |= uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(x, padding))) << shift;
+            }
+#endif
+            
+            classifyScalar(in_header, in_delimiting_character, in_padding_character, out_masks, i); // any remaining characters
+        }
+    }
+}
+
+#endif /* header_classifier_h */
@@ -0,0 +1,202 @@
+//
+//  payload-codec.h
+//  ClientServerShared
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The PayloadCodec functions frame the payloads sent on a connection that negotiated a           //
+// compression codec in its ProtocolPreface. Every payload that is not empty, in either          //
+// direction, is then preceded by an encoding byte. A payload of at least                         //
+// Constants::compression_threshold bytes that shrinks when compressed is sent as the codec's id, //
+// its uncompressed length and the compressed bytes, any other is sent as s_raw followed by the   //
+// payload unchanged.                                                                             //
+//                                                                                                //
+// Note: LZ4 and Zstandard are optional. Each is only built in when the build defines            //
+//       PAYLOAD_CODEC_WITH_LZ4 or PAYLOAD_CODEC_WITH_ZSTD and links the matching library         //
+//       (-llz4 or -lzstd), so having the headers installed alone never adds a dependency. A      //
+//       codec that is not built in is never accepted when a connection is negotiated, so        //
+//       payloads are left as they are.                                                           //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef payload_codec_h
+#define payload_codec_h
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "binary-protocol.h"
+#include "constants.h"
+
+#ifdef PAYLOAD_CODEC_WITH_LZ4
+#define PAYLOAD_CODEC_LZ4_SUPPORTED 1
+#include <lz4.h>
+#endif
+
+#ifdef PAYLOAD_CODEC_WITH_ZSTD
+#define PAYLOAD_CODEC_ZSTD_SUPPORTED 1
+#include <zstd.h>
+#endif
+
+namespace EmersonClientServerFileSystem
+{
+    namespace PayloadCodec
+    {
+        // Note: The ids double as the encoding byte of a payload compressed with the codec, so
+        //       they may only ever be appended.
+        static constexpr int s_none = 0;
+        
+        static constexpr int s_lz4 = 1;
+        
+        static constexpr int s_zstd = 2;
+        
+        static constexpr char s_raw = static_cast<char>(s_none);
+        
+        // ENCODING (1 byte) UNCOMPRESSED_LEN (4 bytes)
+        static constexpr size_t s_compressed_header_len = 5;
+        
+        // returns true if in_codec can be used on a connection, s_none always can
+        static inline bool isSupported(int in_codec)
+        {
+            switch (in_codec)
+            {
+                case s_none:
+                    return true;
+#ifdef PAYLOAD_CODEC_LZ4_SUPPORTED
+                case s_lz4:
+                    return true;
+#endif
+#ifdef PAYLOAD_CODEC_ZSTD_SUPPORTED
+                case s_zstd:
+                    return true;
+#endif
+                default:
+                    return false;
+            }
+        }
+        
+        // returns the number of compressed bytes written to out_data, or 0 if in_data cannot be
+        // compressed into in_capacity bytes
+        static inline size_t compress(int in_codec, [[maybe_unused]] std::string_view in_data, [[maybe_unused]] char * out_data, [[maybe_unused]] size_t in_capacity)
+        {
+            switch (in_codec)
+            {
+#ifdef PAYLOAD_CODEC_LZ4_SUPPORTED
+                case s_lz4:
+                {
+                    int compressed_len = LZ4_compress_fast(in_data.data(), out_data, static_cast<int>(in_data.length()), static_cast<int>(in_capacity), Constants::lz4_acceleration);
+                    
+                    return compressed_len > 0 ? static_cast<size_t>(compressed_len) : 0;
+                }
+#endif
+#ifdef PAYLOAD_CODEC_ZSTD_SUPPORTED
+                case s_zstd:
+                {
+                    size_t compressed_len = ZSTD_compress(out_data, in_capacity, in_data.data(), in_data.length(), Constants::zstd_compression_level);
+                    
+                    return ZSTD_isError(compressed_len) ? 0 : compressed_len;
+                }
+#endif
+                default:
+                    return 0;
+            }
+        }
+        
+        // returns true if in_data decompresses to exactly in_capacity bytes in out_data
+        static inline bool decompress(int in_codec, [[maybe_unused]] std::string_view in_data, [[maybe_unused]] char * out_data, [[maybe_unused]] size_t in_capacity)
+        {
+            switch (in_codec)
+            {
+#ifdef PAYLOAD_CODEC_LZ4_SUPPORTED
+                case s_lz4:
+                    return static_cast<int>(in_capacity) == LZ4_decompress_safe(in_data.data(), out_data, static_cast<int>(in_data.length()), static_cast<int>(in_capacity));
+#endif
+#ifdef PAYLOAD_CODEC_ZSTD_SUPPORTED
+                case s_zstd:
+                    return in_capacity == ZSTD_decompress(out_data, in_capacity, in_data.data(), in_data.length());
+#endif
+                default:
+                    return false;
+            }
+        }
+        
+        // returns in_data framed for a connection that negotiated in_codec
+        static inline std::string encode(int in_codec, std::string_view in_data)
+        {
+            std::string payload;
+            
+            if (in_data.empty()) // requests such as COMMIT carry no payload to frame
+            {
+                return payload;
+            }
+            
+            // Note: Compressed output is only kept if its frame is smaller than the raw frame, so
+            //       the buffer is sized to the payload rather than to the codec's worst case bound.
+            if (!(s_none == in_codec) && in_data.length() >= std::max(Constants::compression_threshold, s_compressed_header_len + 1) && in_data.length() <= Constants::max_decompressed_len)
+            {
+                payload.resize(in_data.length());
+                
+                if (size_t compressed_len = compress(in_codec, in_data, payload.data() + s_compressed_header_len, in_data.length() - s_compressed_header_len))
+                {
+                    payload[0] = static_cast<char>(in_codec);
+                    
+                    LittleEndian::store32(payload.data() + 1, static_cast<uint32_t>(in_data.length()));
+                    
+                    payload.resize(s_compressed_header_len + compressed_len);
+                    
+                    return payload;
+                }
+            }
+            
+            payload.reserve(1 + in_data.length());
+            
+            payload.push_back(s_raw);
+            
+            payload.append(in_data);
+            
+            return payload;
+        }
+        
+        // sets out_data to the payload framed in in_payload for a connection that negotiated
+        // in_codec and returns false if in_payload is not a valid frame
+        static inline bool decode(int in_codec, std::string_view in_payload, std::string& out_data)
+        {
+            if (in_payload.empty())
+            {
+                out_data.clear();
+                
+                return true;
+            }
+            
+            if (s_raw == in_payload[0])
+            {
+                out_data.assign(in_payload.substr(1));
+                
+                return true;
+            }
+            
+            // a payload may only be compressed with the codec negotiated for the connection
+            if (!(static_cast<char>(in_codec) == in_payload[0]) || in_payload.length() < s_compressed_header_len)
+            {
+                return false;
+            }
+            
+            size_t data_len = LittleEndian::load32(in_payload.data() + 1);
+            
+            if (data_len > Constants::max_decompressed_len)
+            {
+                return false;
+            }
+            
+            out_data.resize(data_len);
+            
+            return decompress(in_codec, in_payload.substr(s_compressed_header_len), out_data.data(), data_len);
+        }
+    }
+}
+
+#endif /* payload_codec_h */
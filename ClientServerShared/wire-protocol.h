@@ -7,97 +7,355 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // The WireProtocol class is used to validate requests and responses according to their           //
-// associated regex. WireProtocol is also used to extract the relevant fields from a raw header   //
-// string and place them inside a tuple-like data structure. The current implementation only      //
-// supports parsing of strings where each field is delimited by a space character.                //
+// associated format. WireProtocol is also used to extract the relevant fields from a raw header  //
+// string and place them inside a tuple-like data structure, and to encode fields into a header.  //
+//                                                                                                //
+// Note: A format is described at compile time by a HeaderSchema, which lists the header length,  //
+//       delimiting and padding characters, and the type of each field. HeaderCodec generates the //
+//       validation, decoding, and encoding code for a schema, so a wire protocol with its own    //
+//       fields only needs its own pair of schemas. Headers are classified with HeaderClassifier  //
+//       and then validated and split with bitwise operations on the resulting masks, without     //
+//       allocating.                                                                              //
+//                                                                                                //
+// Note: The schemas in Constants accept exactly the grammar of Constants::request_format and     //
+//       Constants::response_format, which are kept as its specification and checked against in   //
+//       the tests.                                                                               //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #ifndef wire_protocol_h
 #define wire_protocol_h
 
-#include <regex>
-#include <sstream>
+#include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "header-classifier.h"
 
 namespace EmersonClientServerFileSystem
 {
-    class WireProtocol
+    // Command: [A-Z_]+, Integer: [-]?[0-9]+, UnsignedInteger: [0-9]+
+    enum class FieldType { Command, Integer, UnsignedInteger };
+    
+    // Note: A header is its fields separated by DelimitingCharacter, optionally followed by
+    //       DelimitingCharacter and any number of PaddingCharacter, HeaderLen characters in all.
+    template<size_t HeaderLen, char DelimitingCharacter, char PaddingCharacter, FieldType... Fields>
+    struct HeaderSchema
     {
+        // fields are split at the delimiting character, so it must not be able to appear in one
+        static_assert(!(HeaderClassifier::isCommandCharacter(DelimitingCharacter) || HeaderClassifier::isDigit(DelimitingCharacter) || '-' == DelimitingCharacter), "the delimiting character must not belong to any field");
         
-    private:
+        static constexpr size_t s_header_len = HeaderLen;
         
-        using istringstream = std::istringstream;
+        static constexpr char s_delimiting_character = DelimitingCharacter;
         
-        using regex = std::regex;
+        static constexpr char s_padding_character = PaddingCharacter;
         
-        using string = std::string;
+        static constexpr size_t s_num_fields = sizeof...(Fields);
         
-        template<class T>
-        using tuple_size = std::tuple_size<T>;
+        static constexpr FieldType s_field_types[] = {Fields...};
+    };
+    
+    template<class Schema>
+    class HeaderCodec
+    {
         
-        regex m_request_regex;
+    private:
         
-        regex m_response_regex;
+        using string_view = std::string_view;
         
-        ////////////////////////////////////////////////////////////////////////////////////////////
-        // Credit to Stack Overflow @Jean-Michaël Celerier https://bit.ly/2kUTIq2                 //
-        ////////////////////////////////////////////////////////////////////////////////////////////
-        template<std::size_t N>
-        struct num { static const constexpr auto value = N; };
+        using HeaderMasks = HeaderClassifier::HeaderMasks<Schema::s_header_len>;
         
-        template <class F, std::size_t... Is>
-        void for_(F func, std::index_sequence<Is...>) const
+        template<size_t... Is>
+        using index_sequence = std::index_sequence<Is...>;
+        
+        static constexpr size_t s_header_len = Schema::s_header_len;
+        
+        static constexpr size_t s_num_fields = Schema::s_num_fields;
+        
+        struct FieldSpan
         {
-            using expander = int[];
-            (void)expander{0, ((void)func(num<Is>{}), 0)...};
-        }
+            const char * m_begin;
+            const char * m_end;
+        };
         
-        template <std::size_t N, typename F>
-        void for_(F func) const
+        template<size_t I>
+        static bool scanField(const char * in_header, const HeaderMasks& in_masks, size_t& io_pos, FieldSpan& out_field)
         {
-            for_(func, std::make_index_sequence<N>());
+            if constexpr (I > 0)
+            {
+                if (!(io_pos < s_header_len && HeaderMasks::isSet(in_masks.m_delimiting, io_pos)))
+                {
+                    return false;
+                }
+                
+                ++io_pos;
+            }
+            
+            // the delimiting character belongs to no field, so the field ends at the next one
+            size_t field_end = HeaderMasks::findNext(in_masks.m_delimiting, io_pos);
+            
+            size_t digits_begin = io_pos;
+            
+            if constexpr (FieldType::Integer == Schema::s_field_types[I])
+            {
+                if (digits_begin < field_end && HeaderMasks::isSet(in_masks.m_minus, digits_begin))
+                {
+                    ++digits_begin;
+                }
+            }
+            
+            if constexpr (FieldType::Command == Schema::s_field_types[I])
+            {
+                if (!(io_pos < field_end && HeaderMasks::allSet(in_masks.m_command, io_pos, field_end)))
+                {
+                    return false;
+                }
+            }
+            else if (!(digits_begin < field_end && HeaderMasks::allSet(in_masks.m_digit, digits_begin, field_end)))
+            {
+                return false;
+            }
+            
+            out_field.m_begin = in_header + io_pos;
+            
+            out_field.m_end = in_header + field_end;
+            
+            io_pos = field_end;
+            
+            return true;
         }
-        ////////////////////////////////////////////////////////////////////////////////////////////
         
-    public:
+        template<size_t... Is>
+        static bool scanFields(const char * in_header, const HeaderMasks& in_masks, size_t& io_pos, FieldSpan * out_fields, index_sequence<Is...>)
+        {
+            return (scanField<Is>(in_header, in_masks, io_pos, out_fields[Is]) && ...);
+        }
         
-        WireProtocol(const char * in_request_format, const char * in_response_format)
+        // Note: in_header must be null terminated, as with the format regexes a header followed by
+        //       further characters is invalid. Its length is checked before any of it is
+        //       classified, so a shorter string is never read past its null terminator.
+        //
+        // returns true if in_header conforms to Schema, storing where each field lies in
+        // out_fields
+        static bool scan(const char * in_header, FieldSpan * out_fields)
         {
-            assert(!(nullptr == in_request_format));
+            assert(!(nullptr == in_header));
             
-            assert(!(nullptr == in_response_format));
+            if (!(s_header_len == strnlen(in_header, s_header_len + 1)))
+            {
+                return false;
+            }
             
-            m_request_regex = regex(in_request_format);
+            HeaderMasks masks;
             
-            m_response_regex = regex(in_response_format);
+            HeaderClassifier::classify(in_header, Schema::s_delimiting_character, Schema::s_padding_character, masks);
+            
+            // reject a header containing a character outside of every class before looking at its
+            // fields
+            uint64_t any_class[HeaderMasks::s_num_words];
+            
+            for (size_t word = 0; word < HeaderMasks::s_num_words; ++word)
+            {
+                any_class[word] = masks.m_command[word] | masks.m_digit[word] | masks.m_minus[word] | masks.m_delimiting[word] | masks.m_padding[word];
+            }
+            
+            if (!HeaderMasks::allSet(any_class, 0, s_header_len))
+            {
+                return false;
+            }
+            
+            size_t pos = 0;
+            
+            if (!scanFields(in_header, masks, pos, out_fields, std::make_index_sequence<s_num_fields>()))
+            {
+                return false;
+            }
+            
+            // the rest must be a delimiter followed by padding
+            return s_header_len == pos || (HeaderMasks::isSet(masks.m_delimiting, pos) && HeaderMasks::allSet(masks.m_padding, pos + 1, s_header_len));
         }
         
-        bool isValidRequestFormat(const char * in_header) const
+        template<size_t I, class T>
+        static bool decodeField(const FieldSpan& in_field, T& out_value)
         {
-            assert(!(nullptr == in_header));
+            if constexpr (FieldType::Command == Schema::s_field_types[I])
+            {
+                out_value = T(in_field.m_begin, in_field.m_end - in_field.m_begin);
+                
+                return true;
+            }
+            else
+            {
+                auto [ptr, ec] = std::from_chars(in_field.m_begin, in_field.m_end, out_value);
+                
+                return std::errc() == ec && in_field.m_end == ptr;
+            }
+        }
+        
+        template<class MessageTuple, size_t... Is>
+        static bool decodeFields(const FieldSpan * in_fields, MessageTuple& out_message, index_sequence<Is...>)
+        {
+            return (decodeField<Is>(in_fields[Is], std::get<Is>(out_message)) && ...);
+        }
+        
+        template<size_t I, class T>
+        static bool encodeField(char *& io_p, char * in_end, const T& in_value)
+        {
+            if constexpr (I > 0)
+            {
+                if (!(io_p < in_end))
+                {
+                    return false;
+                }
+                
+                *io_p++ = Schema::s_delimiting_character;
+            }
             
-            return regex_match(in_header, m_request_regex);
+            if constexpr (FieldType::Command == Schema::s_field_types[I])
+            {
+                string_view command(in_value);
+                
+                if (static_cast<size_t>(in_end - io_p) < command.length())
+                {
+                    return false;
+                }
+                
+                memcpy(io_p, command.data(), command.length());
+                
+                io_p += command.length();
+                
+                return true;
+            }
+            else
+            {
+                static_assert(std::is_integral_v<T>, "numeric fields must be encoded from integers");
+                
+                auto [ptr, ec] = std::to_chars(io_p, in_end, in_value);
+                
+                io_p = ptr;
+                
+                return std::errc() == ec;
+            }
         }
         
-        bool isValidResponseFormat(const char * in_header) const
+        template<size_t... Is, class... Values>
+        static bool encodeFields(char *& io_p, char * in_end, index_sequence<Is...>, const Values&... in_values)
         {
-            assert(!(nullptr == in_header));
+            return (encodeField<Is>(io_p, in_end, in_values) && ...);
+        }
+        
+    public:
+        
+        static bool isValid(const char * in_header)
+        {
+            FieldSpan fields[s_num_fields];
             
-            return regex_match(in_header, m_response_regex);
+            return scan(in_header, fields);
         }
         
+        // Note: Numeric fields that do not fit in their tuple element are rejected. The format
+        //       regexes place no bound on the number of digits but such a header cannot be
+        //       represented.
+        //
+        // validates in_header as it goes and returns false, leaving out_message partially
+        // assigned, if it is invalid, otherwise every element of out_message but the last (the
+        // payload) is assigned
         template<class MessageTuple>
-        void extractHeaderFields(const char * in_header, MessageTuple& out_message) const
+        static bool decode(const char * in_header, MessageTuple& out_message)
         {
-            assert(!(nullptr == in_header));
+            static_assert(s_num_fields + 1 == std::tuple_size<MessageTuple>::value, "MessageTuple must hold every field and the payload");
+            
+            FieldSpan fields[s_num_fields];
+            
+            return scan(in_header, fields) && decodeFields(fields, out_message, std::make_index_sequence<s_num_fields>());
+        }
+        
+        // writes exactly Schema::s_header_len characters (no null terminator) to out_header and
+        // returns false if the fields do not fit
+        template<class... Values>
+        static bool encode(char * out_header, const Values&... in_values)
+        {
+            static_assert(s_num_fields == sizeof...(Values), "a value must be given for every field");
             
-            auto iss = istringstream(string(in_header));
+            assert(!(nullptr == out_header));
             
-            constexpr int size = tuple_size<MessageTuple>::value;
+            char * p = out_header;
             
-            for_<size - 1>([&] (auto i) {
-                iss >> std::get<i.value>(out_message);
-            });
+            char * end = out_header + Schema::s_header_len;
+            
+            if (!encodeFields(p, end, std::make_index_sequence<s_num_fields>(), in_values...))
+            {
+                return false;
+            }
+            
+            if (p < end)
+            {
+                *p++ = Schema::s_delimiting_character;
+                
+                memset(p, Schema::s_padding_character, end - p);
+            }
+            
+            return true;
+        }
+        
+    };
+    
+    // Note: Codec is HeaderCodec for text headers or BinaryHeaderCodec (see binary-protocol.h) for
+    //       binary headers, each taking its own kind of schema.
+    template<class RequestSchema, class ResponseSchema, template<class> class Codec = HeaderCodec>
+    class WireProtocol
+    {
+        
+    private:
+        
+        using RequestCodec = Codec<RequestSchema>;
+        
+        using ResponseCodec = Codec<ResponseSchema>;
+        
+    public:
+        
+        static constexpr size_t s_request_header_len = RequestSchema::s_header_len;
+        
+        static constexpr size_t s_response_header_len = ResponseSchema::s_header_len;
+        
+        bool isValidRequestFormat(const char * in_header) const
+        {
+            return RequestCodec::isValid(in_header);
+        }
+        
+        bool isValidResponseFormat(const char * in_header) const
+        {
+            return ResponseCodec::isValid(in_header);
+        }
+        
+        template<class MessageTuple>
+        bool extractRequestFields(const char * in_header, MessageTuple& out_message) const
+        {
+            return RequestCodec::decode(in_header, out_message);
+        }
+        
+        template<class MessageTuple>
+        bool extractResponseFields(const char * in_header, MessageTuple& out_message) const
+        {
+            return ResponseCodec::decode(in_header, out_message);
+        }
+        
+        template<class... Values>
+        bool encodeRequest(char * out_header, const Values&... in_values) const
+        {
+            return RequestCodec::encode(out_header, in_values...);
+        }
+        
+        template<class... Values>
+        bool encodeResponse(char * out_header, const Values&... in_values) const
+        {
+            return ResponseCodec::encode(out_header, in_values...);
         }
         
     };
@@ -0,0 +1,146 @@
+//
+//  write-batch.h
+//  ClientServerShared
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The WriteBatch functions encode and decode the payloads of WRITE_BATCH requests and of the ACK //
+// sent in response. A request payload is a series of records, each a sequence number and a       //
+// length followed by that many bytes of data to be written. The ACK payload is a series of       //
+// ranges, each the first and last of a run of consecutive sequence numbers the server accepted.  //
+// The payload of an ASK_RESEND, and of the ACK to a WRITE on a connection that negotiated        //
+// ProtocolPreface::s_nack_flag, holds ranges of sequence numbers the server is missing instead.  //
+//                                                                                                //
+// Note: Sequence numbers, lengths, and the ends of ranges are 32 bit little-endian integers as   //
+//       in binary headers, whichever protocol version the header of the request is sent in.      //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef write_batch_h
+#define write_batch_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "binary-protocol.h"
+
+namespace EmersonClientServerFileSystem
+{
+    namespace WriteBatch
+    {
+        // SEQ_NUM (4 bytes) LENGTH (4 bytes) DATA
+        static constexpr size_t s_record_header_len = 8;
+        
+        // FIRST_SEQ_NUM (4 bytes) LAST_SEQ_NUM (4 bytes)
+        static constexpr size_t s_range_len = 8;
+        
+        static inline void appendRecord(std::string& io_payload, int32_t in_seq_num, std::string_view in_data)
+        {
+            char record_header[s_record_header_len];
+            
+            LittleEndian::store32(record_header, static_cast<uint32_t>(in_seq_num));
+            
+            LittleEndian::store32(record_header + 4, static_cast<uint32_t>(in_data.length()));
+            
+            io_payload.append(record_header, s_record_header_len);
+            
+            io_payload.append(in_data);
+        }
+        
+        // calls in_visit(seq_num, data) for each record of in_payload, in order, and returns false
+        // if in_payload ends part way through a record (in which case records before it have
+        // already been visited)
+        template<class Visitor>
+        static bool forEachRecord(std::string_view in_payload, Visitor&& in_visit)
+        {
+            size_t pos = 0;
+            
+            while (in_payload.length() - pos >= s_record_header_len)
+            {
+                int32_t seq_num = static_cast<int32_t>(LittleEndian::load32(in_payload.data() + pos));
+                
+                size_t data_len = LittleEndian::load32(in_payload.data() + pos + 4);
+                
+                pos += s_record_header_len;
+                
+                if (in_payload.length() - pos < data_len)
+                {
+                    return false;
+                }
+                
+                in_visit(seq_num, in_payload.substr(pos, data_len));
+                
+                pos += data_len;
+            }
+            
+            return in_payload.length() == pos;
+        }
+        
+        static inline void appendRange(std::string& io_payload, int32_t in_first_seq_num, int32_t in_last_seq_num)
+        {
+            char range[s_range_len];
+            
+            LittleEndian::store32(range, static_cast<uint32_t>(in_first_seq_num));
+            
+            LittleEndian::store32(range + 4, static_cast<uint32_t>(in_last_seq_num));
+            
+            io_payload.append(range, s_range_len);
+        }
+        
+        // returns the ranges payload for in_seq_nums, which must be sorted in ascending order
+        // without repeats
+        static inline std::string encodeRanges(const std::vector<int32_t>& in_seq_nums)
+        {
+            std::string payload;
+            
+            for (size_t first = 0, last; first < in_seq_nums.size(); first = last + 1)
+            {
+                for (last = first; last + 1 < in_seq_nums.size() && in_seq_nums[last] + 1 == in_seq_nums[last + 1]; ++last);
+                
+                appendRange(payload, in_seq_nums[first], in_seq_nums[last]);
+            }
+            
+            return payload;
+        }
+        
+        // returns the ranges payload for in_ranges, each the first and last sequence number of a run
+        static inline std::string encodeRanges(const std::vector<std::pair<int32_t, int32_t>>& in_ranges)
+        {
+            std::string payload;
+            
+            payload.reserve(in_ranges.size() * s_range_len);
+            
+            for (const auto& [first_seq_num, last_seq_num] : in_ranges)
+            {
+                appendRange(payload, first_seq_num, last_seq_num);
+            }
+            
+            return payload;
+        }
+        
+        // calls in_visit(first_seq_num, last_seq_num) for each range of in_payload and returns
+        // false if in_payload is not a whole number of ranges
+        template<class Visitor>
+        static bool forEachRange(std::string_view in_payload, Visitor&& in_visit)
+        {
+            if (!(0 == in_payload.length() % s_range_len))
+            {
+                return false;
+            }
+            
+            for (size_t pos = 0; pos < in_payload.length(); pos += s_range_len)
+            {
+                in_visit(static_cast<int32_t>(LittleEndian::load32(in_payload.data() + pos)), static_cast<int32_t>(LittleEndian::load32(in_payload.data() + pos + 4)));
+            }
+            
+            return true;
+        }
+    }
+}
+
+#endif /* write_batch_h */
@@ -16,21 +16,29 @@
 
 // TODO: add test for reading from a very large file
 
-// TODO: add test for multiple concurrent transactions from single client
-
 // TODO: add test where requests have invalid content length values
 
 #include <algorithm>
 #include <array>
+#include <fstream>
 #include <future>
+#include <limits>
 #include <numeric>
 #include <random>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "client.h"
 #include "constants.h"
+#include "crc32c.h"
 #include "errors.h"
 #include "gtest/gtest.h"
+#include "payload-codec.h"
+#include "write-batch.h"
 
 #define CLI_ARGS g_server_ipv4_addr, stoi(g_server_port)
 
@@ -42,20 +50,32 @@ using std::chrono::system_clock;
 
 using std::default_random_engine;
 
+using std::generate;
+
 using std::get;
 
 using std::iota;
 
+using std::numeric_limits;
+
 using std::shuffle;
 
+using std::regex;
+
 using std::stoi;
 
 using std::string;
 
+using std::string_view;
+
 using std::this_thread::sleep_for;
 
 using std::thread;
 
+using std::tuple;
+
+using std::unordered_map;
+
 using std::vector;
 
 static constexpr auto to_string = [](auto t) constexpr -> decltype(auto) { return std::to_string(t);};
@@ -68,6 +88,8 @@ extern std::string g_server_port;
 
 extern std::string g_server_directory;
 
+extern std::string g_server_unix_path;
+
 namespace ResponseFields
 {
     enum ResponseFormat{Command, TxnId, SeqNum, ErrorCode, ContentLen, Data};
@@ -86,6 +108,298 @@ void eraseFile(const string& in_file_name)
     }
 }
 
+// returns the contents of the server log in_log_name, or an empty string if the server directory is
+// unknown
+string readServerLog(const string& in_log_name)
+{
+    std::ifstream log_stream(g_server_directory.empty() ? string() : g_server_directory + in_log_name);
+    
+    std::stringstream log_contents;
+    
+    log_contents << log_stream.rdbuf();
+    
+    return log_contents.str();
+}
+
+// Note: Replays the server logs the way the server does when it restarts. A transaction id seen
+//       once was still open and is restarted, while a second entry for it (timeout, commit, or
+//       abort) ends it. Each file is truncated to the largest size logged for it.
+void replayServerLogs(unordered_map<long long, string>& out_txn_ids_to_file_names, unordered_map<string, long long>& out_file_names_to_file_sizes)
+{
+    for (const char * log_name : {".transactionlog.txt", ".timeoutlog.txt", ".commitlog.txt", ".abortlog.txt"})
+    {
+        std::stringstream ss(readServerLog(log_name));
+        
+        long long txn_id;
+        
+        string file_name;
+        
+        long long file_size;
+        
+        while (ss >> txn_id && ss >> file_name && ss >> file_size)
+        {
+            auto fntfs_it = out_file_names_to_file_sizes.find(file_name);
+            
+            if (end(out_file_names_to_file_sizes) == fntfs_it || file_size > fntfs_it->second)
+            {
+                out_file_names_to_file_sizes[file_name] = file_size;
+            }
+            
+            if (!out_txn_ids_to_file_names.erase(txn_id))
+            {
+                out_txn_ids_to_file_names[txn_id] = file_name;
+            }
+        }
+    }
+}
+
+// Note: Candidates start out as well formed headers with random field values, some of which do
+//       not fit in an int, and up to three characters are then replaced, inserted, or erased so
+//       most candidates sit right on the boundary of the grammar.
+vector<string> generateHeaderCandidates(size_t in_header_len, int in_num_numeric_fields, int in_num_candidates)
+{
+    static const string alphabet = string("AZ_az09-+ \n", 12) + Constants::delimiting_character + Constants::padding_character + '\0';
+    
+    default_random_engine generator(rand());
+    
+    auto random_int = [&](int in_max) { return static_cast<int>(generator() % (in_max + 1)); };
+    
+    vector<string> candidates;
+    
+    for (int i = 0; i < in_num_candidates; ++i)
+    {
+        string header(1 + random_int(10), 'A');
+        
+        for (auto& c : header)
+        {
+            c = "ABCDEFGHIJKLMNOPQRSTUVWXYZ_"[random_int(26)];
+        }
+        
+        for (int field = 0; field < in_num_numeric_fields; ++field)
+        {
+            header += Constants::delimiting_character;
+            
+            if (0 == random_int(3))
+            {
+                header += '-';
+            }
+            
+            header += 0 == random_int(20) ? string(10 + random_int(15), '9') : to_string(random_int(100'000));
+        }
+        
+        if (header.length() < in_header_len)
+        {
+            header += Constants::delimiting_character;
+        }
+        
+        header.append(in_header_len - std::min(in_header_len, header.length()), Constants::padding_character);
+        
+        for (int num_mutations = random_int(3); num_mutations > 0; --num_mutations)
+        {
+            size_t pos = random_int(static_cast<int>(header.length()));
+            
+            char c = alphabet[random_int(static_cast<int>(alphabet.length()) - 1)];
+            
+            switch (random_int(2))
+            {
+                case 0: header[std::min(pos, header.length() - 1)] = c; break;
+                case 1: header.insert(pos, 1, c); break;
+                default: header.erase(std::min(pos, header.length() - 1), 1); break;
+            }
+        }
+        
+        candidates.push_back(move(header));
+    }
+    
+    return candidates;
+}
+
+TEST(WireProtocol, RequestFormatConformance)
+{
+    regex request_regex(Constants::request_format);
+    
+    for (const auto& header : generateHeaderCandidates(Constants::request_header_len, 3, 10'000))
+    {
+        bool regex_match = std::regex_match(header.c_str(), request_regex);
+        
+        ASSERT_EQ(regex_match, Constants::wire_protocol.isValidRequestFormat(header.c_str())) << "\"" << header << "\"";
+        
+        if (regex_match)
+        {
+            tuple<string, int, int, int, string> expected, actual;
+            
+            std::istringstream iss(header);
+            
+            iss >> get<0>(expected) >> get<1>(expected) >> get<2>(expected) >> get<3>(expected);
+            
+            // a field that does not fit in an int fails both extractions
+            ASSERT_EQ(!iss.fail(), Constants::wire_protocol.extractRequestFields(header.c_str(), actual)) << "\"" << header << "\"";
+            
+            if (!iss.fail())
+            {
+                EXPECT_EQ(expected, actual);
+            }
+        }
+    }
+}
+
+TEST(WireProtocol, ResponseFormatConformance)
+{
+    regex response_regex(Constants::response_format);
+    
+    for (const auto& header : generateHeaderCandidates(Constants::response_header_len, 4, 10'000))
+    {
+        bool regex_match = std::regex_match(header.c_str(), response_regex);
+        
+        ASSERT_EQ(regex_match, Constants::wire_protocol.isValidResponseFormat(header.c_str())) << "\"" << header << "\"";
+        
+        if (regex_match)
+        {
+            tuple<string, int, int, int, int, string> expected, actual;
+            
+            std::istringstream iss(header);
+            
+            iss >> get<0>(expected) >> get<1>(expected) >> get<2>(expected) >> get<3>(expected) >> get<4>(expected);
+            
+            // a field that does not fit in an int fails both extractions
+            ASSERT_EQ(!iss.fail(), Constants::wire_protocol.extractResponseFields(header.c_str(), actual)) << "\"" << header << "\"";
+            
+            if (!iss.fail())
+            {
+                EXPECT_EQ(expected, actual);
+            }
+        }
+    }
+}
+
+TEST(WireProtocol, EncodeDecodeRoundTrip)
+{
+    regex request_regex(Constants::request_format);
+    
+    regex response_regex(Constants::response_format);
+    
+    const char * commands[] = {Constants::abort_cmd, Constants::commit_cmd, Constants::new_txn_cmd, Constants::read_cmd, Constants::write_cmd, Constants::ack_cmd, Constants::ask_resend_cmd, Constants::error_cmd};
+    
+    default_random_engine generator(rand());
+    
+    for (int i = 0; i < 1'000; ++i)
+    {
+        string command = commands[generator() % (sizeof(commands) / sizeof(commands[0]))];
+        
+        int txn_id = static_cast<int>(generator()) - (1 << 30), seq_num = static_cast<int>(generator() % 100'000) - 1, error_code = generator() % 100, content_len = generator() % 1'000'000;
+        
+        char request_header[Constants::request_header_len + 1] = {}; // add 1 for null terminator
+        
+        char response_header[Constants::response_header_len + 1] = {}; // add 1 for null terminator
+        
+        ASSERT_TRUE(Constants::wire_protocol.encodeRequest(request_header, command, txn_id, seq_num, content_len));
+        
+        ASSERT_TRUE(Constants::wire_protocol.encodeResponse(response_header, command, txn_id, seq_num, error_code, content_len));
+        
+        EXPECT_TRUE(std::regex_match(request_header, request_regex)) << "\"" << request_header << "\"";
+        
+        EXPECT_TRUE(std::regex_match(response_header, response_regex)) << "\"" << response_header << "\"";
+        
+        tuple<string, int, int, int, string> request;
+        
+        tuple<string, int, int, int, int, string> response;
+        
+        ASSERT_TRUE(Constants::wire_protocol.extractRequestFields(request_header, request));
+        
+        ASSERT_TRUE(Constants::wire_protocol.extractResponseFields(response_header, response));
+        
+        EXPECT_EQ(std::make_tuple(command, txn_id, seq_num, content_len, string()), request);
+        
+        EXPECT_EQ(std::make_tuple(command, txn_id, seq_num, error_code, content_len, string()), response);
+        
+        char binary_request_header[Constants::binary_wire_protocol.s_request_header_len];
+        
+        char binary_response_header[Constants::binary_wire_protocol.s_response_header_len];
+        
+        ASSERT_TRUE(Constants::binary_wire_protocol.encodeRequest(binary_request_header, command, txn_id, seq_num, content_len));
+        
+        ASSERT_TRUE(Constants::binary_wire_protocol.encodeResponse(binary_response_header, command, txn_id, seq_num, error_code, content_len));
+        
+        ASSERT_TRUE(Constants::binary_wire_protocol.extractRequestFields(binary_request_header, request));
+        
+        ASSERT_TRUE(Constants::binary_wire_protocol.extractResponseFields(binary_response_header, response));
+        
+        EXPECT_EQ(std::make_tuple(command, txn_id, seq_num, content_len, string()), request);
+        
+        EXPECT_EQ(std::make_tuple(command, txn_id, seq_num, error_code, content_len, string()), response);
+    }
+    
+    EXPECT_EQ(13u, Constants::binary_wire_protocol.s_request_header_len);
+    
+    EXPECT_EQ(17u, Constants::binary_wire_protocol.s_response_header_len);
+    
+    char binary_request_header[Constants::binary_wire_protocol.s_request_header_len];
+    
+    // commands outside of the command table have no code
+    EXPECT_FALSE(Constants::binary_wire_protocol.encodeRequest(binary_request_header, string("WRRITE"), 0, 0, 0));
+    
+    binary_request_header[0] = 0;
+    
+    EXPECT_FALSE(Constants::binary_wire_protocol.isValidRequestFormat(binary_request_header));
+    
+    // a content length that does not fit in a ContentLen cannot be decoded
+    ASSERT_TRUE(Constants::binary_wire_protocol.encodeRequest(binary_request_header, string(Constants::write_cmd), 0, 0, 3'000'000'000u));
+    
+    tuple<string, int, int, int, string> request;
+    
+    EXPECT_FALSE(Constants::binary_wire_protocol.extractRequestFields(binary_request_header, request));
+    
+    char request_header[Constants::request_header_len + 1] = {}; // add 1 for null terminator
+    
+    // a command filling the whole header leaves no room for the other fields
+    EXPECT_FALSE(Constants::wire_protocol.encodeRequest(request_header, string(Constants::request_header_len, 'A'), 0, 0, 0));
+}
+
+// Note: HeaderLen need not be a multiple of the vector width, so the scalar tail is covered too.
+template<size_t HeaderLen>
+void expectClassifierMatchesScalar(string in_header)
+{
+    in_header.resize(HeaderLen, '\0');
+    
+    HeaderClassifier::HeaderMasks<HeaderLen> masks, expected_masks = {};
+    
+    HeaderClassifier::classify(in_header.data(), Constants::delimiting_character, Constants::padding_character, masks);
+    
+    HeaderClassifier::classifyScalar(in_header.data(), Constants::delimiting_character, Constants::padding_character, expected_masks);
+    
+    for (size_t word = 0; word < masks.s_num_words; ++word)
+    {
+        EXPECT_EQ(expected_masks.m_command[word], masks.m_command[word]) << "\"" << in_header << "\"";
+        EXPECT_EQ(expected_masks.m_digit[word], masks.m_digit[word]) << "\"" << in_header << "\"";
+        EXPECT_EQ(expected_masks.m_minus[word], masks.m_minus[word]) << "\"" << in_header << "\"";
+        EXPECT_EQ(expected_masks.m_delimiting[word], masks.m_delimiting[word]) << "\"" << in_header << "\"";
+        EXPECT_EQ(expected_masks.m_padding[word], masks.m_padding[word]) << "\"" << in_header << "\"";
+    }
+}
+
+TEST(WireProtocol, HeaderClassifierMatchesScalar)
+{
+    for (const auto& header : generateHeaderCandidates(Constants::response_header_len, 4, 1'000))
+    {
+        expectClassifierMatchesScalar<Constants::request_header_len>(header);
+        
+        expectClassifierMatchesScalar<Constants::response_header_len>(header);
+        
+        expectClassifierMatchesScalar<Constants::request_header_len + 35>(header);
+    }
+    
+    // every byte value, including those with the high bit set which a signed compare would
+    // misclassify
+    string all_bytes(256, '\0');
+    
+    iota(all_bytes.begin(), all_bytes.end(), 0);
+    
+    for (size_t offset = 0; offset < all_bytes.length(); offset += Constants::response_header_len)
+    {
+        expectClassifierMatchesScalar<Constants::response_header_len>(all_bytes.substr(offset));
+    }
+}
+
 TEST(ClientOmission, OmittedSequenceNumber)
 {
     Client client(CLI_ARGS);
@@ -124,6 +438,8 @@ TEST(ClientOmission, OmittedSequenceNumber)
     
     EXPECT_EQ(missing_seq_num, get<ResponseFields::SeqNum>(server_response_tuple));
     
+    EXPECT_EQ(WriteBatch::encodeRanges(vector<int>{missing_seq_num}), get<ResponseFields::Data>(server_response_tuple));
+    
     client.sendRequestGetResponse(Constants::write_cmd, txn_id, missing_seq_num, to_string(missing_seq_num));
     
     server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_requests);
@@ -137,6 +453,122 @@ TEST(ClientOmission, OmittedSequenceNumber)
     eraseFile(file_name);
 }
 
+TEST(ClientOmission, MissingSequenceNumberRanges)
+{
+    const int num_requests = 100;
+    
+    const vector<int> missing_seq_nums = {1, 2, 40, 63, 64, 65, 66, 99, 100};
+    
+    const vector<std::pair<int, int>> missing_ranges = {{1, 2}, {40, 40}, {63, 66}, {99, 100}};
+    
+    // every missing sequence number is asked for by the ASK_RESEND to a single COMMIT
+    {
+        Client client(CLI_ARGS);
+        
+        string file_name = "File" + to_string(rand()) + ".txt";
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        EXPECT_NE(txn_id, Constants::default_txn_id);
+        
+        for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_requests; ++seq_num)
+        {
+            if (end(missing_seq_nums) == find(begin(missing_seq_nums), end(missing_seq_nums), seq_num))
+            {
+                client.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, to_string(seq_num) + ";");
+            }
+        }
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_requests);
+        
+        EXPECT_STREQ(Constants::ask_resend_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        EXPECT_EQ(missing_seq_nums.front(), get<ResponseFields::SeqNum>(server_response_tuple));
+        
+        vector<std::pair<int, int>> ranges;
+        
+        EXPECT_TRUE(WriteBatch::forEachRange(get<ResponseFields::Data>(server_response_tuple), [&ranges](int in_first, int in_last) { ranges.emplace_back(in_first, in_last); }));
+        
+        EXPECT_EQ(missing_ranges, ranges);
+        
+        string payload;
+        
+        for (int seq_num : missing_seq_nums)
+        {
+            WriteBatch::appendRecord(payload, seq_num, to_string(seq_num) + ";");
+        }
+        
+        client.sendRequestGetResponse(Constants::write_batch_cmd, txn_id, static_cast<int>(missing_seq_nums.size()), payload);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_requests);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        eraseFile(file_name);
+    }
+    
+    // with the nack flag each gap is reported in the ACK to the WRITE that opened it
+    {
+        Client client(CLI_ARGS);
+        
+        ASSERT_EQ(Constants::binary_protocol_version, client.negotiateProtocolVersion(Constants::binary_protocol_version, ProtocolPreface::s_nack_flag));
+        
+        string file_name = "FileNack" + to_string(rand()) + ".txt";
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        EXPECT_NE(txn_id, Constants::default_txn_id);
+        
+        vector<std::pair<int, int>> ranges;
+        
+        string expected;
+        
+        for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_requests; ++seq_num)
+        {
+            expected += to_string(seq_num) + ";";
+            
+            if (end(missing_seq_nums) == find(begin(missing_seq_nums), end(missing_seq_nums), seq_num))
+            {
+                server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, to_string(seq_num) + ";");
+                
+                EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+                
+                EXPECT_TRUE(WriteBatch::forEachRange(get<ResponseFields::Data>(server_response_tuple), [&ranges](int in_first, int in_last) { ranges.emplace_back(in_first, in_last); }));
+            }
+        }
+        
+        // the last range is only found on COMMIT as no WRITE follows it
+        EXPECT_EQ((vector<std::pair<int, int>>(begin(missing_ranges), prev(end(missing_ranges)))), ranges);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_requests);
+        
+        EXPECT_STREQ(Constants::ask_resend_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        string payload;
+        
+        for (int seq_num : missing_seq_nums)
+        {
+            WriteBatch::appendRecord(payload, seq_num, to_string(seq_num) + ";");
+        }
+        
+        client.sendRequestGetResponse(Constants::write_batch_cmd, txn_id, static_cast<int>(missing_seq_nums.size()), payload);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_requests);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        EXPECT_STREQ(expected.c_str(), get<ResponseFields::Data>(server_response_tuple).c_str());
+        
+        eraseFile(file_name);
+    }
+}
+
 TEST(ClientByzantine, InvalidRequestFormat)
 {
     Client client(CLI_ARGS);
@@ -152,6 +584,29 @@ TEST(ClientByzantine, InvalidRequestFormat)
     EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidMessageFormat).c_str());
 }
 
+TEST(ClientByzantine, ContentLengthTooLarge)
+{
+    Client client(CLI_ARGS);
+    
+    // a well formed header whose payload would be far longer than the server buffers
+    string request = string(Constants::write_cmd) + Constants::delimiting_character + to_string(Constants::default_txn_id) + Constants::delimiting_character + to_string(Constants::initial_seq_num + 1) + Constants::delimiting_character + to_string(numeric_limits<int>::max()) + Constants::delimiting_character;
+    
+    request.append(Constants::request_header_len - request.length(), Constants::padding_character);
+    
+    ASSERT_TRUE(Constants::wire_protocol.isValidRequestFormat(request.c_str()));
+    
+    auto server_response_tuple = client.sendRawRequestGetResponse(request.c_str(), request.length());
+    
+    EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidMessageFormat).c_str());
+    
+    // the server is still running and serving requests
+    Client other_client(CLI_ARGS);
+    
+    server_response_tuple = other_client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, "File" + to_string(rand()) + ".txt");
+    
+    EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+}
+
 TEST(ClientByzantine, InvalidCommand)
 {
     Client client(CLI_ARGS);
@@ -226,6 +681,66 @@ TEST(ClientByzantine, RepeatedSequenceNumber)
     EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::RepeatedSequenceNumber).c_str());
 }
 
+TEST(ClientByzantine, SequenceNumberOutOfRange)
+{
+    Client client(CLI_ARGS);
+    
+    int txn_id = Constants::default_txn_id;
+    
+    string data = "Here is my data that goes into file";
+    
+    string file_name = "File" + to_string(rand()) + ".txt";
+    
+    auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, txn_id, Constants::initial_seq_num, file_name);
+    
+    txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+    
+    EXPECT_NE(txn_id, Constants::default_txn_id);
+    
+    server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, Constants::max_seq_num, data);
+    
+    EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+    
+    server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, Constants::max_seq_num);
+    
+    EXPECT_STREQ(Constants::ask_resend_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+    
+    EXPECT_EQ(Constants::initial_seq_num + 1, get<ResponseFields::SeqNum>(server_response_tuple));
+    
+    server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, Constants::max_seq_num + 1, data);
+    
+    EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::SequenceNumberOutOfRange).c_str());
+}
+
+TEST(ClientByzantine, WriteBatchRecordCountExceedsPayload)
+{
+    string file_name = "File" + to_string(rand()) + ".txt";
+    
+    // SEQ_NUM claims more records than the empty payload can hold, each on a fresh connection as
+    // the server closes one after an error
+    for (int seq_num : {numeric_limits<int>::max(), -1})
+    {
+        Client client(CLI_ARGS);
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        EXPECT_NE(txn_id, Constants::default_txn_id);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_batch_cmd, txn_id, seq_num, "");
+        
+        EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidMessageFormat).c_str());
+    }
+    
+    // the server is still running and serving requests
+    Client other_client(CLI_ARGS);
+    
+    auto server_response_tuple = other_client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+    
+    EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+}
+
 TEST(ClientByzantine, CommitWithInvalidSequenceNumber)
 {
     Client client(CLI_ARGS);
@@ -368,9 +883,9 @@ TEST(ClientFailstop, TransactionTimeout)
     EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidTransactionId).c_str());
 }
 
-TEST(NetworkFailure, LostAck)
+TEST(ClientFailstop, TransactionTimeoutAfterLastRequest)
 {
-    Client client(CLI_ARGS);
+    Client client1(CLI_ARGS);
     
     string data = "Here is my data that goes into file";
     
@@ -380,17 +895,172 @@ TEST(NetworkFailure, LostAck)
     
     string file_name = "File" + to_string(rand()) + ".txt";
     
-    auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, txn_id, seq_num++, file_name);
+    auto server_response_tuple = client1.sendRequestGetResponse(Constants::new_txn_cmd, txn_id, seq_num++, file_name);
     
     txn_id = get<ResponseFields::TxnId>(server_response_tuple);
     
     EXPECT_NE(txn_id, Constants::default_txn_id);
     
-    client.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, data);
+    // each request restarts the timeout, so the transaction outlives its first timeout
+    sleep_for(seconds(Constants::transaction_timeout_seconds / 2));
     
-    client.sendRequestGetResponse(Constants::commit_cmd, txn_id, seq_num);
+    server_response_tuple = client1.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num++, data);
     
-    server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, seq_num);
+    EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+    
+    sleep_for(seconds(Constants::transaction_timeout_seconds / 2 + 1));
+    
+    server_response_tuple = client1.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num++, data);
+    
+    EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+    
+    sleep_for(seconds(Constants::transaction_timeout_seconds + 1));
+    
+    Client client2(CLI_ARGS);
+    
+    server_response_tuple = client2.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, data);
+    
+    EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidTransactionId).c_str());
+    
+    if (!g_server_directory.empty())
+    {
+        string log_entry = to_string(txn_id) + " " + file_name + " ";
+        
+        // the timeout is logged just after the transaction is removed
+        for (int attempt = 0; attempt < 10 && string::npos == readServerLog(".timeoutlog.txt").find(log_entry); ++attempt)
+        {
+            sleep_for(milliseconds(Constants::timer_tick_milliseconds));
+        }
+        
+        EXPECT_NE(string::npos, readServerLog(".timeoutlog.txt").find(log_entry));
+    }
+}
+
+TEST(ClientFailstop, IdleConnectionTimeout)
+{
+    Client client(CLI_ARGS);
+    
+    int txn_id = Constants::default_txn_id;
+    
+    int seq_num = Constants::initial_seq_num;
+    
+    string file_name = "File" + to_string(rand()) + ".txt";
+    
+    auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, txn_id, seq_num, file_name);
+    
+    EXPECT_NE(get<ResponseFields::TxnId>(server_response_tuple), Constants::default_txn_id);
+    
+    EXPECT_FALSE(client.isClosedByServer(Constants::connection_timeout_seconds * 1000 / 2));
+    
+    EXPECT_TRUE(client.isClosedByServer((Constants::connection_timeout_seconds / 2 + 2) * 1000));
+    
+    Client other_client(CLI_ARGS);
+    
+    server_response_tuple = other_client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+    
+    EXPECT_NE(get<ResponseFields::TxnId>(server_response_tuple), Constants::default_txn_id);
+}
+
+TEST(ClientFailstop, RecoveryFromGroupCommittedLogs)
+{
+    // Note: The server cannot be restarted from here, so its logs are replayed as it would replay
+    //       them. Transactions are committed, aborted, or left open all at once so their log
+    //       entries are flushed in the same groups.
+    if (g_server_directory.empty())
+    {
+        return;
+    }
+    
+    const int num_clients = 24;
+    
+    const string data = "Here is my data that goes into file";
+    
+    vector<int> txn_ids(num_clients);
+    
+    vector<string> file_names(num_clients);
+    
+    std::promise<void> start_promise;
+    
+    std::shared_future<void> start = start_promise.get_future().share();
+    
+    vector<thread> threads;
+    
+    for (int cid = 0; cid < num_clients; ++cid)
+    {
+        file_names[cid] = "File" + to_string(cid) + "-" + to_string(rand()) + ".txt";
+        
+        threads.emplace_back([&, cid]()
+        {
+            Client client(CLI_ARGS);
+            
+            start.wait();
+            
+            auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_names[cid]);
+            
+            txn_ids[cid] = get<ResponseFields::TxnId>(server_response_tuple);
+            
+            client.sendRequestGetResponse(Constants::write_cmd, txn_ids[cid], Constants::initial_seq_num + 1, data);
+            
+            if (2 != cid % 3) // every third transaction is left open
+            {
+                server_response_tuple = client.sendRequestGetResponse(0 == cid % 3 ? Constants::commit_cmd : Constants::abort_cmd, txn_ids[cid], Constants::initial_seq_num + 1);
+                
+                EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+            }
+        });
+    }
+    
+    start_promise.set_value();
+    
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    
+    unordered_map<long long, string> txn_ids_to_file_names;
+    
+    unordered_map<string, long long> file_names_to_file_sizes;
+    
+    replayServerLogs(txn_ids_to_file_names, file_names_to_file_sizes);
+    
+    for (int cid = 0; cid < num_clients; ++cid)
+    {
+        EXPECT_NE(txn_ids[cid], Constants::default_txn_id);
+        
+        EXPECT_EQ(2 == cid % 3, 1 == txn_ids_to_file_names.count(txn_ids[cid]));
+        
+        if (0 == cid % 3)
+        {
+            EXPECT_EQ(static_cast<long long>(data.size()), file_names_to_file_sizes[file_names[cid]]);
+            
+            eraseFile(file_names[cid]);
+        }
+    }
+}
+
+TEST(NetworkFailure, LostAck)
+{
+    Client client(CLI_ARGS);
+    
+    string data = "Here is my data that goes into file";
+    
+    int txn_id = Constants::default_txn_id;
+    
+    int seq_num = Constants::initial_seq_num;
+    
+    string file_name = "File" + to_string(rand()) + ".txt";
+    
+    auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, txn_id, seq_num++, file_name);
+    
+    txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+    
+    EXPECT_NE(txn_id, Constants::default_txn_id);
+    
+    client.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, data);
+    
+    client.sendRequestGetResponse(Constants::commit_cmd, txn_id, seq_num);
+    
+    server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, seq_num);
     
     EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
     
@@ -418,6 +1088,55 @@ TEST(Client, NewTransaction)
     EXPECT_STREQ("", data.c_str());
 }
 
+TEST(Client, ConcurrentNewTransactions)
+{
+    const int num_clients = 16;
+    
+    const int num_txns = 50;
+    
+    vector<vector<int>> txn_ids(num_clients);
+    
+    vector<thread> threads;
+    
+    for (int cid = 0; cid < num_clients; ++cid)
+    {
+        threads.emplace_back([&, cid]()
+                             {
+                                 Client client(CLI_ARGS);
+                                 
+                                 string file_name = "File" + to_string(cid) + "-" + to_string(rand()) + ".txt";
+                                 
+                                 // the transactions are left to time out as ending one closes the connection
+                                 for (int i = 0; i < num_txns; ++i)
+                                 {
+                                     int txn_id = get<ResponseFields::TxnId>(client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name));
+                                     
+                                     txn_ids[cid].push_back(txn_id);
+                                 }
+                             });
+    }
+    
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    
+    vector<int> all_txn_ids;
+    
+    for (const auto& client_txn_ids : txn_ids)
+    {
+        all_txn_ids.insert(end(all_txn_ids), begin(client_txn_ids), end(client_txn_ids));
+    }
+    
+    EXPECT_EQ(static_cast<size_t>(num_clients * num_txns), all_txn_ids.size());
+    
+    EXPECT_TRUE(std::all_of(begin(all_txn_ids), end(all_txn_ids), [](int in_txn_id) { return in_txn_id > Constants::default_txn_id; }));
+    
+    std::sort(begin(all_txn_ids), end(all_txn_ids));
+    
+    EXPECT_EQ(end(all_txn_ids), std::adjacent_find(begin(all_txn_ids), end(all_txn_ids)));
+}
+
 TEST(Client, PipelinedRequests)
 {
     Client client(CLI_ARGS);
@@ -565,7 +1284,7 @@ TEST(Client, MultipleClientInteractionSameTransactionParallel)
                                       
                                       client.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, data);
                                   });
-        
+                                  
         expected.insert(0, data);
     }
     
@@ -585,6 +1304,681 @@ TEST(Client, MultipleClientInteractionSameTransactionParallel)
     eraseFile(file_name);
 }
 
+TEST(Client, ParallelTransactionsDifferentFiles)
+{
+    // Note: Every client opens its own connection and commits to its own file so no two
+    //       requests contend for the same transaction or file, only for shared server state.
+    //       The same load is run one client at a time and then all at once, so the two elapsed
+    //       times show how much of it the server overlaps. Comparing shard counts takes a run
+    //       against a server built with Constants::backend_shards = 1.
+    const int num_clients = 32;
+    
+    const int num_writes = 20;
+    
+    auto runClient = [](int in_cid, const string& in_file_name)
+    {
+        Client client(CLI_ARGS);
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, in_file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+        {
+            client.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, to_string(in_cid) + ":" + to_string(seq_num) + ";");
+        }
+        
+        client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_writes);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, in_file_name);
+        
+        return get<ResponseFields::Data>(server_response_tuple);
+    };
+    
+    for (bool parallel : {false, true})
+    {
+        vector<string> file_names(num_clients);
+        
+        vector<string> expected(num_clients);
+        
+        vector<string> actual(num_clients);
+        
+        vector<thread> threads;
+        
+        auto start_time = system_clock::now();
+        
+        for (int cid = 0; cid < num_clients; ++cid)
+        {
+            file_names[cid] = "File" + to_string(cid) + "-" + to_string(rand()) + ".txt";
+            
+            for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+            {
+                expected[cid] += to_string(cid) + ":" + to_string(seq_num) + ";";
+            }
+            
+            if (parallel)
+            {
+                threads.emplace_back([&, cid]() { actual[cid] = runClient(cid, file_names[cid]); });
+            }
+            else
+            {
+                actual[cid] = runClient(cid, file_names[cid]);
+            }
+        }
+        
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        
+        auto elapsed = std::chrono::duration_cast<milliseconds>(system_clock::now() - start_time);
+        
+        std::cout << num_clients << (parallel ? " parallel" : " sequential") << " transactions completed in " << elapsed.count() << " ms" << std::endl;
+        
+        for (int cid = 0; cid < num_clients; ++cid)
+        {
+            EXPECT_STREQ(expected[cid].c_str(), actual[cid].c_str());
+            
+            eraseFile(file_names[cid]);
+        }
+    }
+}
+
+TEST(Client, ConcurrentCommitsAreLogged)
+{
+    if (g_server_directory.empty())
+    {
+        return;
+    }
+    
+    const int num_clients = 32;
+    
+    const string data = "Here is my data that goes into file";
+    
+    vector<int> txn_ids(num_clients);
+    
+    vector<string> file_names(num_clients);
+    
+    std::promise<void> commit_promise;
+    
+    std::shared_future<void> commit = commit_promise.get_future().share();
+    
+    vector<thread> threads;
+    
+    for (int cid = 0; cid < num_clients; ++cid)
+    {
+        file_names[cid] = "File" + to_string(cid) + "-" + to_string(rand()) + ".txt";
+        
+        threads.emplace_back([&, cid]()
+        {
+            Client client(CLI_ARGS);
+            
+            auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_names[cid]);
+            
+            txn_ids[cid] = get<ResponseFields::TxnId>(server_response_tuple);
+            
+            client.sendRequestGetResponse(Constants::write_cmd, txn_ids[cid], Constants::initial_seq_num + 1, data);
+            
+            // every client commits at once so the commits share log flushes
+            commit.wait();
+            
+            server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_ids[cid], Constants::initial_seq_num + 1);
+            
+            EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        });
+    }
+    
+    commit_promise.set_value();
+    
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    
+    // the leading newline lets the first entry be found like any other
+    string transaction_log = "\n" + readServerLog(".transactionlog.txt");
+    
+    string commit_log = "\n" + readServerLog(".commitlog.txt");
+    
+    for (int cid = 0; cid < num_clients; ++cid)
+    {
+        EXPECT_NE(txn_ids[cid], Constants::default_txn_id);
+        
+        // each entry must be a whole line, so entries flushed together did not interleave
+        string entry = to_string(txn_ids[cid]) + " " + file_names[cid] + " ";
+        
+        EXPECT_NE(string::npos, transaction_log.find("\n" + entry + "0\n"));
+        
+        EXPECT_NE(string::npos, commit_log.find("\n" + entry + to_string(data.size()) + "\n"));
+        
+        eraseFile(file_names[cid]);
+    }
+}
+
+TEST(Client, UnixDomainSocketTransport)
+{
+    // Note: Runs the same transaction over TCP and over the Unix domain socket, one request per
+    //       round trip so the elapsed times compare the per-request cost of the transports.
+    if (g_server_unix_path.empty())
+    {
+        std::cout << "no server unix path provided... skipping" << std::endl;
+        
+        return;
+    }
+    
+    const int num_writes = 2'000;
+    
+    string expected;
+    
+    for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+    {
+        expected += to_string(seq_num) + ";";
+    }
+    
+    auto run_transaction = [&](Client& io_client, const string& in_transport)
+    {
+        string file_name = "File" + in_transport + "-" + to_string(rand()) + ".txt";
+        
+        auto start_time = system_clock::now();
+        
+        auto server_response_tuple = io_client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+        {
+            io_client.sendRequestGetResponse(Constants::write_cmd, txn_id, seq_num, to_string(seq_num) + ";");
+        }
+        
+        server_response_tuple = io_client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_writes);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(system_clock::now() - start_time);
+        
+        std::cout << in_transport << ": " << num_writes + 2 << " round trips completed in " << elapsed.count() << " us" << std::endl;
+        
+        server_response_tuple = io_client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        EXPECT_STREQ(expected.c_str(), get<ResponseFields::Data>(server_response_tuple).c_str());
+        
+        eraseFile(file_name);
+    };
+    
+    Client tcp_client(CLI_ARGS);
+    
+    Client unix_client(g_server_unix_path);
+    
+    run_transaction(tcp_client, "TCP");
+    
+    run_transaction(unix_client, "Unix");
+}
+
+TEST(Client, BinaryProtocol)
+{
+    Client binary_client(CLI_ARGS);
+    
+    Client text_client(CLI_ARGS);
+    
+    Client downgraded_client(CLI_ARGS);
+    
+    ASSERT_EQ(Constants::binary_protocol_version, binary_client.negotiateProtocolVersion(Constants::binary_protocol_version));
+    
+    // an unsupported version is answered with the text protocol
+    ASSERT_EQ(Constants::text_protocol_version, downgraded_client.negotiateProtocolVersion(99));
+    
+    const int num_writes = 100;
+    
+    string expected;
+    
+    for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+    {
+        expected += to_string(seq_num) + ";";
+    }
+    
+    // Note: The clients take turns so requests in both protocols are in flight on the same port.
+    string file_names[] = {"FileBinary-" + to_string(rand()) + ".txt", "FileText-" + to_string(rand()) + ".txt", "FileDowngraded-" + to_string(rand()) + ".txt"};
+    
+    Client * clients[] = {&binary_client, &text_client, &downgraded_client};
+    
+    int txn_ids[3];
+    
+    for (int cid = 0; cid < 3; ++cid)
+    {
+        auto server_response_tuple = clients[cid]->sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_names[cid]);
+        
+        txn_ids[cid] = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        EXPECT_NE(txn_ids[cid], Constants::default_txn_id);
+    }
+    
+    for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+    {
+        for (int cid = 0; cid < 3; ++cid)
+        {
+            clients[cid]->sendRequest(Constants::write_cmd, txn_ids[cid], seq_num, to_string(seq_num) + ";");
+        }
+    }
+    
+    for (int cid = 0; cid < 3; ++cid)
+    {
+        for (int i = 0; i < num_writes; ++i)
+        {
+            EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(clients[cid]->getResponse()).c_str());
+        }
+        
+        auto server_response_tuple = clients[cid]->sendRequestGetResponse(Constants::commit_cmd, txn_ids[cid], num_writes);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        server_response_tuple = clients[cid]->sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_names[cid]);
+        
+        EXPECT_STREQ(expected.c_str(), get<ResponseFields::Data>(server_response_tuple).c_str());
+        
+        eraseFile(file_names[cid]);
+    }
+    
+    // errors are reported in the protocol of the connection
+    auto server_response_tuple = binary_client.sendRequestGetResponse(Constants::write_cmd, Constants::default_txn_id, Constants::initial_seq_num, "data");
+    
+    EXPECT_STREQ(Constants::error_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+    
+    EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidTransactionId).c_str());
+}
+
+TEST(Client, MultiplexedRequests)
+{
+    Client client(CLI_ARGS);
+    
+    Client text_client(CLI_ARGS);
+    
+    ASSERT_EQ(Constants::binary_protocol_version, client.negotiateProtocolVersion(Constants::binary_protocol_version, ProtocolPreface::s_multiplexed_flag));
+    
+    ASSERT_TRUE(client.isMultiplexed());
+    
+    // the text protocol cannot carry correlation ids so the flag is refused
+    ASSERT_EQ(Constants::text_protocol_version, text_client.negotiateProtocolVersion(Constants::text_protocol_version, ProtocolPreface::s_multiplexed_flag));
+    
+    EXPECT_FALSE(text_client.isMultiplexed());
+    
+    const int num_txns = 8;
+    
+    const int num_writes = 50;
+    
+    string file_names[num_txns];
+    
+    uint32_t correlation_ids[num_txns];
+    
+    int txn_ids[num_txns];
+    
+    // Note: Every request below is sent before any response is read, so the transactions are in
+    //       progress concurrently on the one connection and each response is claimed by id in
+    //       the reverse order to the requests.
+    for (int i = 0; i < num_txns; ++i)
+    {
+        file_names[i] = "FileMultiplexed" + to_string(i) + "-" + to_string(rand()) + ".txt";
+        
+        correlation_ids[i] = client.sendRequest(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_names[i]);
+    }
+    
+    for (int i = num_txns - 1; i >= 0; --i)
+    {
+        auto server_response_tuple = client.getResponse(correlation_ids[i]);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        txn_ids[i] = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        EXPECT_NE(txn_ids[i], Constants::default_txn_id);
+    }
+    
+    vector<tuple<uint32_t, int, int>> writes; // correlation id, transaction, sequence number
+    
+    for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+    {
+        for (int i = 0; i < num_txns; ++i)
+        {
+            writes.emplace_back(client.sendRequest(Constants::write_cmd, txn_ids[i], seq_num, to_string(i) + ":" + to_string(seq_num) + ";"), txn_ids[i], seq_num);
+        }
+    }
+    
+    // an error ends only the transaction it belongs to and leaves the connection open
+    auto server_response_tuple = client.getResponse(client.sendRequest(Constants::write_cmd, Constants::default_txn_id, Constants::initial_seq_num + 1, "data"));
+    
+    EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidTransactionId).c_str());
+    
+    for (auto it = writes.rbegin(); writes.rend() != it; ++it)
+    {
+        auto [correlation_id, txn_id, seq_num] = *it;
+        
+        server_response_tuple = client.getResponse(correlation_id);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        EXPECT_EQ(txn_id, get<ResponseFields::TxnId>(server_response_tuple));
+        
+        EXPECT_EQ(seq_num, get<ResponseFields::SeqNum>(server_response_tuple));
+    }
+    
+    // every WRITE has been acknowledged so the transactions can be committed concurrently, apart
+    // from the last which is aborted without closing the connection
+    for (int i = 0; i < num_txns; ++i)
+    {
+        correlation_ids[i] = client.sendRequest(num_txns - 1 == i ? Constants::abort_cmd : Constants::commit_cmd, txn_ids[i], num_writes);
+    }
+    
+    for (int i = 0; i < num_txns; ++i)
+    {
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(client.getResponse(correlation_ids[i])).c_str());
+    }
+    
+    for (int i = 0; i < num_txns - 1; ++i)
+    {
+        correlation_ids[i] = client.sendRequest(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_names[i]);
+    }
+    
+    for (int i = num_txns - 2; i >= 0; --i)
+    {
+        string expected;
+        
+        for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+        {
+            expected += to_string(i) + ":" + to_string(seq_num) + ";";
+        }
+        
+        EXPECT_STREQ(expected.c_str(), get<ResponseFields::Data>(client.getResponse(correlation_ids[i])).c_str());
+        
+        eraseFile(file_names[i]);
+    }
+}
+
+TEST(Client, WriteBatch)
+{
+    const int num_writes = 100;
+    
+    const int omitted_seq_num = 37;
+    
+    for (int protocol_version : {Constants::text_protocol_version, Constants::binary_protocol_version})
+    {
+        Client client(CLI_ARGS);
+        
+        ASSERT_EQ(protocol_version, client.negotiateProtocolVersion(protocol_version));
+        
+        string file_name = "FileBatch" + to_string(protocol_version) + "-" + to_string(rand()) + ".txt";
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        EXPECT_NE(txn_id, Constants::default_txn_id);
+        
+        vector<int> seq_nums(num_writes);
+        
+        iota(begin(seq_nums), end(seq_nums), Constants::initial_seq_num + 1);
+        
+        shuffle(begin(seq_nums), end(seq_nums), default_random_engine(rand()));
+        
+        // records may be in any order, one is left out to be resent
+        string payload;
+        
+        for (int seq_num : seq_nums)
+        {
+            if (!(omitted_seq_num == seq_num))
+            {
+                WriteBatch::appendRecord(payload, seq_num, to_string(seq_num) + ";");
+            }
+        }
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_batch_cmd, txn_id, num_writes - 1, payload);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        EXPECT_EQ(num_writes - 1, get<ResponseFields::SeqNum>(server_response_tuple));
+        
+        vector<std::pair<int, int>> ranges;
+        
+        EXPECT_TRUE(WriteBatch::forEachRange(get<ResponseFields::Data>(server_response_tuple), [&ranges](int in_first, int in_last) { ranges.emplace_back(in_first, in_last); }));
+        
+        EXPECT_EQ((vector<std::pair<int, int>>{{Constants::initial_seq_num + 1, omitted_seq_num - 1}, {omitted_seq_num + 1, num_writes}}), ranges);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_writes);
+        
+        EXPECT_STREQ(Constants::ask_resend_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        EXPECT_EQ(omitted_seq_num, get<ResponseFields::SeqNum>(server_response_tuple));
+        
+        // a record already received is skipped rather than ending the transaction
+        payload.clear();
+        
+        WriteBatch::appendRecord(payload, omitted_seq_num + 1, "repeated;");
+        
+        WriteBatch::appendRecord(payload, omitted_seq_num, to_string(omitted_seq_num) + ";");
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_batch_cmd, txn_id, 2, payload);
+        
+        EXPECT_EQ(1, get<ResponseFields::SeqNum>(server_response_tuple));
+        
+        ranges.clear();
+        
+        EXPECT_TRUE(WriteBatch::forEachRange(get<ResponseFields::Data>(server_response_tuple), [&ranges](int in_first, int in_last) { ranges.emplace_back(in_first, in_last); }));
+        
+        EXPECT_EQ((vector<std::pair<int, int>>{{omitted_seq_num, omitted_seq_num}}), ranges);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, num_writes);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        string expected;
+        
+        for (int seq_num = Constants::initial_seq_num + 1; seq_num <= num_writes; ++seq_num)
+        {
+            expected += to_string(seq_num) + ";";
+        }
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        EXPECT_STREQ(expected.c_str(), get<ResponseFields::Data>(server_response_tuple).c_str());
+        
+        eraseFile(file_name);
+        
+        // SEQ_NUM must hold the number of records
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_batch_cmd, txn_id, 3, payload);
+        
+        EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidMessageFormat).c_str());
+    }
+}
+
+TEST(Client, Put)
+{
+    for (int protocol_version : {Constants::text_protocol_version, Constants::binary_protocol_version})
+    {
+        Client client(CLI_ARGS);
+        
+        ASSERT_EQ(protocol_version, client.negotiateProtocolVersion(protocol_version));
+        
+        string file_name = "FilePut" + to_string(protocol_version) + "-" + to_string(rand()) + ".txt";
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::put_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name + '\0' + "first;");
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        EXPECT_GT(txn_id, Constants::default_txn_id);
+        
+        // a second PUT appends to the file as a committed transaction does
+        server_response_tuple = client.sendRequestGetResponse(Constants::put_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name + '\0' + "second;");
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        EXPECT_NE(txn_id, get<ResponseFields::TxnId>(server_response_tuple));
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        EXPECT_STREQ("first;second;", get<ResponseFields::Data>(server_response_tuple).c_str());
+        
+        // a PUT is committed as it is acknowledged, so its id is spent
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, Constants::initial_seq_num + 1, "late;");
+        
+        EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidOperation).c_str());
+        
+        eraseFile(file_name);
+    }
+    
+    Client client1(CLI_ARGS);
+    
+    auto server_response_tuple = client1.sendRequestGetResponse(Constants::put_cmd, Constants::default_txn_id, Constants::initial_seq_num + 1, string("FilePut.txt") + '\0' + "first;");
+    
+    EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidSequenceNumber).c_str());
+    
+    // the file name must be followed by a null character
+    Client client2(CLI_ARGS);
+    
+    server_response_tuple = client2.sendRequestGetResponse(Constants::put_cmd, Constants::default_txn_id, Constants::initial_seq_num, "FilePut.txt");
+    
+    EXPECT_STREQ(get<ResponseFields::Data>(server_response_tuple).c_str(), Errors::getErrorMessage(Errors::InvalidMessageFormat).c_str());
+}
+
+TEST(Client, PayloadCompression)
+{
+    string compressible;
+    
+    for (int i = 0; i < 200; ++i)
+    {
+        compressible += "line " + to_string(i % 10) + " of a highly compressible file;";
+    }
+    
+    for (int payload_codec : {PayloadCodec::s_lz4, PayloadCodec::s_zstd})
+    {
+        Client client(CLI_ARGS);
+        
+        ASSERT_EQ(Constants::binary_protocol_version, client.negotiateProtocolVersion(Constants::binary_protocol_version, 0, payload_codec));
+        
+        // a codec that is not built in is declined and payloads are sent as they are
+        EXPECT_EQ(PayloadCodec::isSupported(payload_codec) ? payload_codec : PayloadCodec::s_none, client.getPayloadCodec());
+        
+        string file_name = "FileCompressed" + to_string(payload_codec) + "-" + to_string(rand()) + ".txt";
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        // the second payload is shorter than Constants::compression_threshold so is not compressed
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, 1, compressible);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, 2, "end;");
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, 2);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        EXPECT_EQ(compressible + "end;", get<ResponseFields::Data>(server_response_tuple));
+        
+        if (!(PayloadCodec::s_none == client.getPayloadCodec()))
+        {
+            EXPECT_LT(static_cast<size_t>(get<ResponseFields::ContentLen>(server_response_tuple)), compressible.length() / 4);
+        }
+        
+        eraseFile(file_name);
+    }
+    
+    // compression is only negotiated with the binary protocol
+    Client text_client(CLI_ARGS);
+    
+    ASSERT_EQ(Constants::text_protocol_version, text_client.negotiateProtocolVersion(Constants::text_protocol_version, 0, PayloadCodec::s_lz4));
+    
+    EXPECT_EQ(PayloadCodec::s_none, text_client.getPayloadCodec());
+}
+
+TEST(Client, PayloadChecksum)
+{
+    EXPECT_EQ(0xE3069283, Crc32c::compute("123456789"));
+    
+    string contents(3 * 4096 * 2 + 13, ' '); // long enough to be checksummed in stripes
+    
+    generate(begin(contents), end(contents), [i = 0]() mutable { return static_cast<char>('!' + i++ * 7 % 90); });
+    
+    uint32_t head_checksum = Crc32c::compute(string_view(contents).substr(0, 1000)), tail_checksum = Crc32c::compute(string_view(contents).substr(1000));
+    
+    EXPECT_EQ(Crc32c::compute(contents), Crc32c::combine(head_checksum, tail_checksum, contents.length() - 1000));
+    
+    EXPECT_EQ(Crc32c::compute(contents), Crc32c::compute(string_view(contents).substr(1000), head_checksum));
+    
+    // the crc32 instruction, when this processor has it, agrees with the tables
+    EXPECT_EQ(Crc32c::compute(contents), ~Crc32c::extendScalar(~uint32_t(0), contents.data(), contents.length()));
+    
+    for (int payload_codec : {PayloadCodec::s_none, PayloadCodec::s_lz4})
+    {
+        Client client(CLI_ARGS);
+        
+        ASSERT_EQ(Constants::binary_protocol_version, client.negotiateProtocolVersion(Constants::binary_protocol_version, ProtocolPreface::s_checksum_flag, payload_codec));
+        
+        ASSERT_TRUE(client.isChecksummed());
+        
+        string file_name = "FileChecksummed" + to_string(payload_codec) + "-" + to_string(rand()) + ".txt";
+        
+        auto server_response_tuple = client.sendRequestGetResponse(Constants::new_txn_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        int txn_id = get<ResponseFields::TxnId>(server_response_tuple);
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, 1, contents);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        // a payload that does not match its checksum is rejected without ending the transaction
+        char checksum[Crc32c::s_checksum_len];
+        
+        LittleEndian::store32(checksum, ~Crc32c::compute("end;"));
+        
+        string corrupted_payload = string(checksum, sizeof(checksum)) + (PayloadCodec::s_none == client.getPayloadCodec() ? string("end;") : PayloadCodec::encode(client.getPayloadCodec(), "end;"));
+        
+        server_response_tuple = client.sendUnframedRequestGetResponse(Constants::write_cmd, txn_id, 2, corrupted_payload);
+        
+        EXPECT_STREQ(Constants::error_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        EXPECT_EQ(Errors::getErrorCode(Errors::ChecksumMismatch), get<ResponseFields::ErrorCode>(server_response_tuple));
+        
+        EXPECT_EQ(2, get<ResponseFields::SeqNum>(server_response_tuple));
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::write_cmd, txn_id, 2, "end;");
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::commit_cmd, txn_id, 2);
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        // the client verifies the checksum of every response, here the one recorded on commit
+        server_response_tuple = client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        EXPECT_EQ(contents + "end;", get<ResponseFields::Data>(server_response_tuple));
+        
+        // and here the one recorded on commit extended by that of the data appended by the PUT
+        server_response_tuple = client.sendRequestGetResponse(Constants::put_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name + '\0' + "appended;");
+        
+        EXPECT_STREQ(Constants::ack_cmd, get<ResponseFields::Command>(server_response_tuple).c_str());
+        
+        server_response_tuple = client.sendRequestGetResponse(Constants::read_cmd, Constants::default_txn_id, Constants::initial_seq_num, file_name);
+        
+        EXPECT_EQ(contents + "end;appended;", get<ResponseFields::Data>(server_response_tuple));
+        
+        eraseFile(file_name);
+    }
+    
+    // checksums are only negotiated with the binary protocol
+    Client text_client(CLI_ARGS);
+    
+    ASSERT_EQ(Constants::text_protocol_version, text_client.negotiateProtocolVersion(Constants::text_protocol_version, ProtocolPreface::s_checksum_flag));
+    
+    EXPECT_FALSE(text_client.isChecksummed());
+}
+
 TEST(Client, AbortTransaction)
 {
     Client client1(CLI_ARGS);
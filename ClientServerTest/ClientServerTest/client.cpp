@@ -6,7 +6,10 @@
 //  Copyright © 2019 Emerson Dolinski. All rights reserved.
 //
 
+#include <cstring>
+
 #include <arpa/inet.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include "client.h"
@@ -27,6 +30,13 @@ Client::Client(string in_serv_ipv4_addr, int in_serv_portno) : m_serv_ipv4_addr(
     connectToServer();
 }
 
+Client::Client(string in_serv_unix_path) : m_serv_portno(0), m_serv_unix_path(move(in_serv_unix_path))
+{
+    initializeUnixSocket();
+    
+    connectToServer();
+}
+
 Client::~Client()
 {
     close(m_sockfd);
@@ -34,43 +44,116 @@ Client::~Client()
 
 Client::ResponseTuple Client::getResponse()
 {
-    ResponseTuple server_response_tuple;
+    if (!m_early_responses.empty())
+    {
+        auto it = begin(m_early_responses);
+        
+        ResponseTuple server_response_tuple = move(it->second);
+        
+        m_early_responses.erase(it);
+        
+        return server_response_tuple;
+    }
     
-    char response_header[Constants::response_header_len + 1]; // add 1 for null terminator
+    uint32_t correlation_id;
     
-    bzero(response_header, Constants::response_header_len + 1);
+    return readResponse(correlation_id);
+}
+
+Client::ResponseTuple Client::getResponse(uint32_t in_correlation_id)
+{
+    if (!isMultiplexed())
+    {
+        return getResponse();
+    }
+    
+    auto it = m_early_responses.find(in_correlation_id);
     
-    if (ReadWriteHelper::readFileDescriptor(m_sockfd, response_header, Constants::response_header_len) < 0)
+    if (end(m_early_responses) != it)
     {
-        perror("Error reading from socket");
+        ResponseTuple server_response_tuple = move(it->second);
         
-        exit(EXIT_FAILURE);
+        m_early_responses.erase(it);
+        
+        return server_response_tuple;
     }
-    else
+    
+    while (1)
     {
-        EXPECT_TRUE(Constants::wire_protocol.isValidResponseFormat(response_header));
+        uint32_t correlation_id;
         
-        Constants::wire_protocol.extractHeaderFields(response_header, server_response_tuple);
+        ResponseTuple server_response_tuple = readResponse(correlation_id);
         
-        auto& [command, txn_id, seq_num, error_code, content_len, data] = server_response_tuple;
+        if (in_correlation_id == correlation_id)
+        {
+            return server_response_tuple;
+        }
         
-        char response_payload[content_len + 1]; // add 1 for null terminator
+        m_early_responses.emplace(correlation_id, move(server_response_tuple));
+    }
+}
+
+int Client::getPayloadCodec() const
+{
+    return m_payload_codec;
+}
+
+bool Client::isClosedByServer(int in_timeout_milliseconds)
+{
+    pollfd poll_fd = {m_sockfd, POLLIN, 0};
+    
+    if (poll(&poll_fd, 1, in_timeout_milliseconds) <= 0)
+    {
+        return false;
+    }
+    
+    char byte;
+    
+    // a closed connection reads as end of file, or as reset if it was closed with data unread
+    return recv(m_sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) <= 0;
+}
+
+bool Client::isChecksummed() const
+{
+    return m_protocol_flags & ProtocolPreface::s_checksum_flag;
+}
+
+bool Client::isMultiplexed() const
+{
+    return m_protocol_flags & ProtocolPreface::s_multiplexed_flag;
+}
+
+int Client::negotiateProtocolVersion(int in_protocol_version, int in_flags, int in_payload_codec)
+{
+    char preface[ProtocolPreface::s_preface_len];
+    
+    ProtocolPreface::encode(preface, in_protocol_version, in_flags, in_payload_codec);
+    
+    if (ReadWriteHelper::writeFileDescriptor(m_sockfd, preface, sizeof(preface)) < 0)
+    {
+        perror("Error writing to socket");
         
-        bzero(response_payload, content_len + 1);
+        exit(EXIT_FAILURE);
+    }
+    
+    if (ReadWriteHelper::readFileDescriptor(m_sockfd, preface, sizeof(preface)) < 0)
+    {
+        perror("Error reading from socket");
         
-        if (ReadWriteHelper::readFileDescriptor(m_sockfd, response_payload, content_len) < 0)
-        {
-            perror("Error reading from socket");
-            
-            exit(EXIT_FAILURE);
-        }
-        else
-        {
-            data = response_payload;
-        }
+        exit(EXIT_FAILURE);
     }
     
-    return server_response_tuple;
+    int accepted_version = Constants::text_protocol_version, accepted_flags = 0, accepted_codec = PayloadCodec::s_none;
+    
+    EXPECT_EQ(static_cast<int>(sizeof(preface)), ProtocolPreface::decode(preface, sizeof(preface), accepted_version, accepted_flags, accepted_codec));
+    
+    m_protocol_version = accepted_version;
+    
+    m_protocol_flags = accepted_flags;
+    
+    m_payload_codec = accepted_codec;
+    
+    return m_protocol_version;
 }
 
 void Client::printResponse(const ResponseTuple& in_server_response_tuple)
@@ -80,9 +163,9 @@ void Client::printResponse(const ResponseTuple& in_server_response_tuple)
     std::cout << command << " " << id << " " << seq_num << " " << error_code << " " << content_len << " " << data << std::endl;
 }
 
-void Client::sendRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data)
+uint32_t Client::sendRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data)
 {
-    sendRequest(in_command, in_txn_id, in_seq_num, in_data, false);
+    return writeRequest(in_command, in_txn_id, in_seq_num, in_data);
 }
 
 Client::ResponseTuple Client::sendRawRequestGetResponse(const char * in_raw_request, size_t in_raw_request_len)
@@ -103,7 +186,12 @@ Client::ResponseTuple Client::sendRawRequestGetResponse(const char * in_raw_requ
 
 Client::ResponseTuple Client::sendRequestGetResponse(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data)
 {
-    return sendRequest(in_command, in_txn_id, in_seq_num, in_data, true);
+    return getResponse(writeRequest(in_command, in_txn_id, in_seq_num, in_data));
+}
+
+Client::ResponseTuple Client::sendUnframedRequestGetResponse(const string& in_command, int in_txn_id, int in_seq_num, const string& in_payload)
+{
+    return getResponse(writeRequest(in_command, in_txn_id, in_seq_num, in_payload, false));
 }
 
 // ↑                                                                                            ↑ //
@@ -116,7 +204,7 @@ Client::ResponseTuple Client::sendRequestGetResponse(const string& in_command, i
 
 void Client::connectToServer()
 {
-    if (connect(m_sockfd,(struct sockaddr *) &m_serv_addr, sizeof(m_serv_addr)) < 0)
+    if (connect(m_sockfd,(struct sockaddr *) &m_serv_addr, m_serv_len) < 0)
     {
         perror("Error connecting");
         
@@ -135,49 +223,192 @@ void Client::initializeSocket()
         exit(EXIT_FAILURE);
     }
     
-    m_serv_len = sizeof(m_serv_addr);
+    auto& serv_addr = reinterpret_cast<struct sockaddr_in&>(m_serv_addr);
+    
+    bzero((char *) &m_serv_addr, sizeof(m_serv_addr));
+    
+    m_serv_len = sizeof(serv_addr);
     
-    m_serv_addr.sin_family = AF_INET;
+    serv_addr.sin_family = AF_INET;
     
-    m_serv_addr.sin_addr.s_addr = inet_addr(m_serv_ipv4_addr.c_str());
+    serv_addr.sin_addr.s_addr = inet_addr(m_serv_ipv4_addr.c_str());
     
-    m_serv_addr.sin_port = htons(m_serv_portno);
+    serv_addr.sin_port = htons(m_serv_portno);
 }
 
-Client::ResponseTuple Client::sendRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data, bool in_expectResponse)
+void Client::initializeUnixSocket()
 {
-    string request_header;
+    m_sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
     
-    request_header.reserve(Constants::request_header_len);
+    if (m_sockfd < 0)
+    {
+        perror("Error opening socket");
+        
+        exit(EXIT_FAILURE);
+    }
+    
+    auto& serv_addr = reinterpret_cast<struct sockaddr_un&>(m_serv_addr);
+    
+    bzero((char *) &m_serv_addr, sizeof(m_serv_addr));
     
-    request_header = in_command + Constants::delimiting_character + to_string(in_txn_id) + Constants::delimiting_character + to_string(in_seq_num) + Constants::delimiting_character + to_string(in_data.length());
+    m_serv_len = sizeof(serv_addr);
     
-    if (request_header.length() < Constants::request_header_len)
+    serv_addr.sun_family = AF_UNIX;
+    
+    strncpy(serv_addr.sun_path, m_serv_unix_path.c_str(), sizeof(serv_addr.sun_path) - 1);
+}
+
+Client::ResponseTuple Client::readResponse(uint32_t& out_correlation_id)
+{
+    ResponseTuple server_response_tuple;
+    
+    out_correlation_id = 0;
+    
+    if (isMultiplexed())
     {
-        request_header.push_back(Constants::delimiting_character);
+        char correlation_id[CorrelationId::s_correlation_id_len];
+        
+        if (ReadWriteHelper::readFileDescriptor(m_sockfd, correlation_id, sizeof(correlation_id)) < 0)
+        {
+            perror("Error reading from socket");
+            
+            exit(EXIT_FAILURE);
+        }
+        
+        out_correlation_id = CorrelationId::decode(correlation_id);
     }
     
-    request_header.append(Constants::request_header_len - request_header.length(), Constants::padding_character);
+    bool binary = Constants::binary_protocol_version == m_protocol_version;
     
-#ifdef DEBUG
-    if (!Constants::wire_protocol.isValidRequestFormat(request_header.c_str()))
+    size_t response_header_len = binary ? Constants::binary_wire_protocol.s_response_header_len : Constants::response_header_len;
+    
+    char response_header[Constants::response_header_len + 1]; // add 1 for null terminator
+    
+    bzero(response_header, Constants::response_header_len + 1);
+    
+    if (ReadWriteHelper::readFileDescriptor(m_sockfd, response_header, response_header_len) < 0)
     {
-        std::cerr << "Client generated header \"" << request_header << "\" is invalid" << std::endl;
+        perror("Error reading from socket");
+        
+        exit(EXIT_FAILURE);
+    }
+    else
+    {
+        EXPECT_TRUE(binary ? Constants::binary_wire_protocol.extractResponseFields(response_header, server_response_tuple) : Constants::wire_protocol.extractResponseFields(response_header, server_response_tuple));
+        
+        auto& [command, txn_id, seq_num, error_code, content_len, data] = server_response_tuple;
+        
+        char response_payload[content_len + 1]; // add 1 for null terminator
+        
+        bzero(response_payload, content_len + 1);
+        
+        if (ReadWriteHelper::readFileDescriptor(m_sockfd, response_payload, content_len) < 0)
+        {
+            perror("Error reading from socket");
+            
+            exit(EXIT_FAILURE);
+        }
+        else
+        {
+            data.assign(response_payload, content_len); // the payload of a WRITE_BATCH ACK is binary
+            
+            uint32_t checksum = 0;
+            
+            if (isChecksummed() && content_len > 0)
+            {
+                EXPECT_LE(static_cast<int>(Crc32c::s_checksum_len), content_len);
+                
+                checksum = LittleEndian::load32(data.data());
+                
+                data.erase(0, Crc32c::s_checksum_len);
+            }
+            
+            // Note: CONTENT_LEN is left as received so callers can tell how much was sent.
+            if (!(PayloadCodec::s_none == m_payload_codec))
+            {
+                string payload;
+                
+                payload.swap(data);
+                
+                EXPECT_TRUE(PayloadCodec::decode(m_payload_codec, payload, data));
+            }
+            
+            if (isChecksummed())
+            {
+                EXPECT_EQ(checksum, Crc32c::compute(data));
+            }
+        }
+    }
+    
+    return server_response_tuple;
+}
+
+uint32_t Client::writeRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data, bool in_frame)
+{
+    // the payload is framed before the header is encoded as framing may compress it
+    string payload = !in_frame || PayloadCodec::s_none == m_payload_codec ? in_data : PayloadCodec::encode(m_payload_codec, in_data);
+    
+    if (in_frame && isChecksummed() && !in_data.empty())
+    {
+        char checksum[Crc32c::s_checksum_len];
+        
+        LittleEndian::store32(checksum, Crc32c::compute(in_data));
+        
+        payload.insert(0, checksum, sizeof(checksum));
+    }
+    
+    string request;
+    
+    uint32_t correlation_id = 0;
+    
+    if (isMultiplexed())
+    {
+        correlation_id = m_next_correlation_id++;
+        
+        request.assign(CorrelationId::s_correlation_id_len, '\0');
+        
+        CorrelationId::encode(request.data(), correlation_id);
     }
-#endif
     
-    string request = move(request_header);
+    if (Constants::binary_protocol_version == m_protocol_version)
+    {
+        size_t header_begin = request.length();
+        
+        request.resize(header_begin + Constants::binary_wire_protocol.s_request_header_len, '\0');
+        
+        [[maybe_unused]] bool encoded = Constants::binary_wire_protocol.encodeRequest(request.data() + header_begin, in_command, in_txn_id, in_seq_num, payload.length());
+        
+#ifdef DEBUG
+        if (!encoded)
+        {
+            std::cerr << "Client could not encode binary header for \"" << in_command << "\"" << std::endl;
+        }
+#endif
+    }
+    else
+    {
+        request.assign(Constants::request_header_len, Constants::padding_character);
+        
+        [[maybe_unused]] bool encoded = Constants::wire_protocol.encodeRequest(request.data(), in_command, in_txn_id, in_seq_num, payload.length());
+        
+#ifdef DEBUG
+        if (!(encoded && Constants::wire_protocol.isValidRequestFormat(request.c_str())))
+        {
+            std::cerr << "Client generated header \"" << request << "\" is invalid" << std::endl;
+        }
+#endif
+    }
     
-    request += in_data;
+    request += payload;
     
-    if (ReadWriteHelper::writeFileDescriptor(m_sockfd, request.c_str(), request.length()) < 0)
+    if (ReadWriteHelper::writeFileDescriptor(m_sockfd, request.data(), request.length()) < 0)
     {
         perror("Error writing to socket");
         
         exit(EXIT_FAILURE);
     }
     
-    return in_expectResponse ? getResponse() : /* else return an empty response  */ ResponseTuple();
+    return correlation_id;
 }
 
 // ↑                                                                                            ↑ //
@@ -14,11 +14,18 @@
 #ifndef client_h
 #define client_h
 
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+
+#include "constants.h"
+#include "crc32c.h"
+#include "payload-codec.h"
 
 namespace EmersonClientServerFileSystem
 {
@@ -31,6 +38,9 @@ namespace EmersonClientServerFileSystem
         
         using ResponseTuple = std::tuple<string, int, int, int, int, string>;
         
+        template<class K, class V>
+        using unordered_map = std::unordered_map<K, V>;
+        
         static constexpr auto to_string = [](auto t) constexpr -> decltype(auto) { return std::to_string(t);};
         
         int m_sockfd;
@@ -39,31 +49,88 @@ namespace EmersonClientServerFileSystem
         
         int m_serv_portno;
         
+        string m_serv_unix_path;
+        
         socklen_t m_serv_len;
         
-        struct sockaddr_in m_serv_addr;
+        // Note: Holds a sockaddr_in or a sockaddr_un depending on the transport, m_serv_len is the
+        //       size of whichever is in use.
+        struct sockaddr_storage m_serv_addr;
+        
+        int m_protocol_version = Constants::text_protocol_version;
+        
+        int m_protocol_flags = 0;
+        
+        int m_payload_codec = PayloadCodec::s_none;
+        
+        uint32_t m_next_correlation_id = 0;
+        
+        // responses received while waiting for the response to another request
+        unordered_map<uint32_t, ResponseTuple> m_early_responses;
         
         void connectToServer();
         
         void initializeSocket();
         
-        ResponseTuple sendRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data, bool in_expectResponse);
+        void initializeUnixSocket();
+        
+        // reads the next response from the socket, setting out_correlation_id if multiplexed
+        ResponseTuple readResponse(uint32_t& out_correlation_id);
+        
+        // returns the correlation id the request was sent with, or 0 if not multiplexed, in_data is
+        // sent as it is if in_frame is false
+        uint32_t writeRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data, bool in_frame = true);
         
     public:
         
         Client(string in_serv_ipv4_addr, int in_serv_portno);
         
+        // connects over a Unix domain socket, for a server running on the same host
+        explicit Client(string in_serv_unix_path);
+        
         ~Client();
         
+        // returns the next response received, which on a multiplexed connection may belong to any
+        // request whose response has not yet been returned
         ResponseTuple getResponse();
         
+        // returns the response to the request sent with in_correlation_id, keeping any other
+        // responses received in the meantime for later
+        ResponseTuple getResponse(uint32_t in_correlation_id);
+        
+        // returns the PayloadCodec the server accepted, payloads are framed and unframed with it
+        // transparently
+        int getPayloadCodec() const;
+        
+        // returns true if the server closes the connection within in_timeout_milliseconds without
+        // sending anything further
+        bool isClosedByServer(int in_timeout_milliseconds);
+        
+        // returns true if the server accepted ProtocolPreface::s_checksum_flag, payloads are then
+        // checksummed and verified transparently
+        bool isChecksummed() const;
+        
+        // returns true if the server accepted ProtocolPreface::s_multiplexed_flag
+        bool isMultiplexed() const;
+        
+        // Note: Must be called before any request is sent.
+        //
+        // sends a preface asking the server for in_protocol_version, in_flags and in_payload_codec
+        // and returns the version the server accepted, which every later request and response on
+        // this client uses
+        int negotiateProtocolVersion(int in_protocol_version, int in_flags = 0, int in_payload_codec = PayloadCodec::s_none);
+        
         static void printResponse(const ResponseTuple& in_server_response_tuple);
         
-        void sendRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data = "");
+        // returns the correlation id to pass to getResponse on a multiplexed connection
+        uint32_t sendRequest(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data = "");
         
         ResponseTuple sendRawRequestGetResponse(const char * in_raw_request, size_t in_raw_request_len);
         
         ResponseTuple sendRequestGetResponse(const string& in_command, int in_txn_id, int in_seq_num, const string& in_data = "");
+        
+        // sends in_payload without framing it as negotiated, e.g. to send a corrupted checksum
+        ResponseTuple sendUnframedRequestGetResponse(const string& in_command, int in_txn_id, int in_seq_num, const string& in_payload);
     };
 }
 
@@ -21,6 +21,8 @@ string g_server_port;
 
 string g_server_directory;
 
+string g_server_unix_path;
+
 using namespace EmersonClientServerFileSystem;
 
 int main(int argc, char *argv[])
@@ -41,7 +43,7 @@ int main(int argc, char *argv[])
     }
     else
     {
-        std::unordered_map<string, string&> supported_arguments{{ArgumentHelper::server_ipv4_addr_arg_prefix, g_server_ipv4_addr}, {ArgumentHelper::server_port_arg_prefix, g_server_port}, {ArgumentHelper::server_directory_arg_prefix, g_server_directory}};
+        std::unordered_map<string, string&> supported_arguments{{ArgumentHelper::server_ipv4_addr_arg_prefix, g_server_ipv4_addr}, {ArgumentHelper::server_port_arg_prefix, g_server_port}, {ArgumentHelper::server_directory_arg_prefix, g_server_directory}, {ArgumentHelper::server_unix_path_arg_prefix, g_server_unix_path}};
         
         ArgumentHelper::extractArguments(argc, argv, supported_arguments);
         
@@ -53,6 +55,11 @@ int main(int argc, char *argv[])
         {
             ArgumentHelper::validateDirectory(g_server_directory);
         }
+        
+        if (!g_server_unix_path.empty()) // if optional unix path argument specified, validate it
+        {
+            ArgumentHelper::validateUnixPath(g_server_unix_path);
+        }
     }
     
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,179 @@
+//
+//  event-notifier.cpp
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#include <errno.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include <unistd.h>
+
+#include "event-notifier.h"
+
+using namespace EmersonClientServerFileSystem;
+
+EventNotifier::EventNotifier()
+{
+#ifdef __linux__
+    m_notifier_fd = epoll_create1(EPOLL_CLOEXEC);
+    
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    
+    if (m_notifier_fd < 0 || m_wakeup_fd < 0)
+    {
+        perror("Error creating event notifier");
+        
+        exit(EXIT_FAILURE);
+    }
+    
+    add(m_wakeup_fd, this);
+#else
+    m_notifier_fd = kqueue();
+    
+    if (m_notifier_fd < 0)
+    {
+        perror("Error creating event notifier");
+        
+        exit(EXIT_FAILURE);
+    }
+    
+    NativeEvent change;
+    
+    EV_SET(&change, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, this);
+    
+    if (kevent(m_notifier_fd, &change, 1, nullptr, 0, nullptr) < 0)
+    {
+        perror("Error creating event notifier");
+        
+        exit(EXIT_FAILURE);
+    }
+#endif
+}
+
+EventNotifier::~EventNotifier()
+{
+#ifdef __linux__
+    close(m_wakeup_fd);
+#endif
+    
+    close(m_notifier_fd);
+}
+
+void EventNotifier::add(int in_fd, void * in_p_context, bool in_writable)
+{
+#ifdef __linux__
+    NativeEvent event;
+    
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (in_writable ? static_cast<uint32_t>(EPOLLOUT) : 0);
+    
+    event.data.ptr = in_p_context;
+    
+    if (epoll_ctl(m_notifier_fd, EPOLL_CTL_ADD, in_fd, &event) < 0)
+#else
+    NativeEvent changes[2];
+    
+    EV_SET(&changes[0], in_fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, in_p_context);
+    
+    EV_SET(&changes[1], in_fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, in_p_context);
+    
+    if (kevent(m_notifier_fd, changes, in_writable ? 2 : 1, nullptr, 0, nullptr) < 0)
+#endif
+    {
+        perror("Error registering file descriptor with event notifier");
+        
+        exit(EXIT_FAILURE);
+    }
+}
+
+void EventNotifier::remove(int in_fd)
+{
+#ifdef __linux__
+    epoll_ctl(m_notifier_fd, EPOLL_CTL_DEL, in_fd, nullptr);
+#else
+    NativeEvent changes[2];
+    
+    EV_SET(&changes[0], in_fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    
+    EV_SET(&changes[1], in_fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+    
+    // the write filter is deleted last as doing so fails if in_fd was only registered for reads
+    kevent(m_notifier_fd, changes, 2, nullptr, 0, nullptr);
+#endif
+}
+
+int EventNotifier::wait(Event * out_events, int in_max_events, int in_timeout_milliseconds)
+{
+    assert(!(nullptr == out_events));
+    
+    NativeEvent native_events[in_max_events];
+    
+#ifdef __linux__
+    int num_native_events = epoll_wait(m_notifier_fd, native_events, in_max_events, in_timeout_milliseconds);
+#else
+    struct timespec timeout = {in_timeout_milliseconds / 1'000, (in_timeout_milliseconds % 1'000) * 1'000'000};
+    
+    int num_native_events = kevent(m_notifier_fd, nullptr, 0, native_events, in_max_events, in_timeout_milliseconds < 0 ? nullptr : &timeout);
+#endif
+    
+    if (num_native_events < 0)
+    {
+        if (!(EINTR == errno))
+        {
+            perror("Error waiting on event notifier");
+        }
+        
+        return 0;
+    }
+    
+    int num_events = 0;
+    
+    for (int i = 0; i < num_native_events; ++i)
+    {
+#ifdef __linux__
+        const auto& native_event = native_events[i];
+        
+        if (this == native_event.data.ptr) // wakeup, drain the eventfd counter
+        {
+            eventfd_t value;
+            
+            eventfd_read(m_wakeup_fd, &value);
+            
+            continue;
+        }
+        
+        out_events[num_events++] = {native_event.data.ptr, 0 != (native_event.events & EPOLLIN), 0 != (native_event.events & EPOLLOUT), 0 != (native_event.events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))};
+#else
+        const auto& native_event = native_events[i];
+        
+        if (EVFILT_USER == native_event.filter) // wakeup
+        {
+            continue;
+        }
+        
+        out_events[num_events++] = {native_event.udata, EVFILT_READ == native_event.filter, EVFILT_WRITE == native_event.filter, 0 != (native_event.flags & (EV_EOF | EV_ERROR))};
+#endif
+    }
+    
+    return num_events;
+}
+
+void EventNotifier::wakeup()
+{
+#ifdef __linux__
+    eventfd_write(m_wakeup_fd, 1);
+#else
+    NativeEvent change;
+    
+    EV_SET(&change, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+    
+    kevent(m_notifier_fd, &change, 1, nullptr, 0, nullptr);
+#endif
+}
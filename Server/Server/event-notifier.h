@@ -0,0 +1,88 @@
+//
+//  event-notifier.h
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The EventNotifier class wraps the readiness notification facility of the host operating system //
+// (epoll on Linux and kqueue on macOS/BSD). File descriptors are registered edge-triggered along //
+// with an opaque context pointer which is handed back when the file descriptor becomes readable  //
+// (or writable, if requested), so callers never need to search a table of file descriptors to    //
+// find the state associated with an event.                                                       //
+//                                                                                                //
+// Note: Because registrations are edge-triggered, a consumer that is woken must read from the    //
+//       file descriptor until the read would block before waiting on the EventNotifier again.    //
+//                                                                                                //
+// Note: wait blocks until at least one registered file descriptor is ready, until wakeup is      //
+//       called from another thread, or until an optional timeout elapses.                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef event_notifier_h
+#define event_notifier_h
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+
+namespace EmersonClientServerFileSystem
+{
+    class EventNotifier
+    {
+        
+    public:
+        
+        struct Event
+        {
+            void * m_p_context;
+            bool m_readable;
+            bool m_writable;
+            bool m_hangup;
+        };
+        
+    private:
+        
+#ifdef __linux__
+        using NativeEvent = struct epoll_event;
+#else
+        using NativeEvent = struct kevent;
+#endif
+        
+        int m_notifier_fd;
+        
+#ifdef __linux__
+        int m_wakeup_fd; // eventfd used to interrupt epoll_wait
+#endif
+        
+    public:
+        
+        EventNotifier();
+        
+        ~EventNotifier();
+        
+        EventNotifier(const EventNotifier&) = delete;
+        
+        EventNotifier& operator=(const EventNotifier&) = delete;
+        
+        // registers in_fd for edge-triggered read notifications, and write notifications if
+        // in_writable is true, in_p_context is returned as part of each Event generated for in_fd
+        void add(int in_fd, void * in_p_context, bool in_writable = false);
+        
+        // unregisters in_fd (Note: closing in_fd also unregisters it)
+        void remove(int in_fd);
+        
+        // blocks until at least one registered file descriptor is ready, wakeup is called, or
+        // in_timeout_milliseconds elapse (never if negative) and returns the number of events
+        // written to out_events
+        int wait(Event * out_events, int in_max_events, int in_timeout_milliseconds = -1);
+        
+        // causes a thread blocked in wait to return
+        void wakeup();
+        
+    };
+}
+
+#endif /* event_notifier_h */
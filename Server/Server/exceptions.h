@@ -30,6 +30,8 @@ namespace EmersonClientServerFileSystem
         
         struct ErrorAddingFileAttributes : public exception {};
         
+        struct ErrorAllocatingTransactionId : public exception {};
+        
     };
 }
 
@@ -9,24 +9,24 @@
 #ifdef DEBUG
 #include <iostream>
 #endif
+#include <climits>
+#include <string>
 
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "exceptions.h"
 #include "file.h"
+#include "io-ring.h"
 #include "read-write-helper.h"
 
-extern std::mutex g_mtx;
-
 using namespace EmersonClientServerFileSystem;
 
 File::File(const string& in_file_path, int in_flags) : m_flags(in_flags)
 {
-    std::lock_guard<std::mutex> global_grd(g_mtx);
-    
     m_fd = open(in_file_path.c_str(), in_flags, 0777);
     
     if (-1 == m_fd)
@@ -36,22 +36,20 @@ File::File(const string& in_file_path, int in_flags) : m_flags(in_flags)
     else
     {
 #ifdef DEBUG
-        std::cout << "opened file descriptor " << m_fd << std::endl;
+        std::cout << "opened file descriptor " + std::to_string(m_fd) + "\n" << std::flush;
 #endif
     }
 }
 
 File::~File()
 {
-    if (O_WRONLY == (O_WRONLY & m_flags) || O_RDWR == (O_RDWR & m_flags))
+    if (!m_synced && (O_WRONLY == (O_WRONLY & m_flags) || O_RDWR == (O_RDWR & m_flags)))
     {
         fsync(m_fd);
         
         fsync(m_fd);
     }
     
-    std::lock_guard<std::mutex> global_grd(g_mtx);
-    
     if (close(m_fd) < 0)
     {
 #ifdef DEBUG
@@ -61,7 +59,7 @@ File::~File()
     else
     {
 #ifdef DEBUG
-        std::cout << "closing file descriptor " << m_fd << std::endl;
+        std::cout << "closing file descriptor " + std::to_string(m_fd) + "\n" << std::flush;
 #endif
     }
 }
@@ -100,18 +98,14 @@ File::string File::read()
 {
     if (O_RDONLY == (O_RDONLY & m_flags) || O_RDWR == (O_RDWR & m_flags))
     {
-        int buffer_len = static_cast<int>(getFileSize());
-        
-        char buffer[buffer_len + 1]; // add 1 for null terminator
-        
-        bzero(buffer, buffer_len + 1);
+        string buffer(getFileSize(), '\0'); // read in place rather than through a copy
         
-        if (ReadWriteHelper::readFileDescriptor(m_fd, buffer, buffer_len) < 0)
+        if (ReadWriteHelper::readFileDescriptor(m_fd, &buffer[0], buffer.length()) < 0)
         {
             throw typename Exception::ErrorReadingFromFile();
         }
         
-        return string(buffer);
+        return buffer;
     }
     else
     {
@@ -137,3 +131,58 @@ void File::write(const string& in_buffer_str)
         exit(EXIT_FAILURE);
     }
 }
+
+void File::writeAndSync(const vector<const string *>& in_buffers)
+{
+    if (O_WRONLY == (O_WRONLY & m_flags) || O_RDWR == (O_RDWR & m_flags))
+    {
+        auto p_ring = IoRing::getThreadRing();
+        
+        if (p_ring)
+        {
+            vector<struct iovec> iovs;
+            
+            iovs.reserve(in_buffers.size());
+            
+            for (auto p_buffer : in_buffers)
+            {
+                if (!p_buffer->empty())
+                {
+                    iovs.push_back({const_cast<char *>(p_buffer->data()), p_buffer->length()});
+                }
+            }
+            
+            for (size_t i = 0; i < iovs.size(); i += IOV_MAX)
+            {
+                p_ring->queueWritev(m_fd, iovs.data() + i, static_cast<int>(std::min<size_t>(IOV_MAX, iovs.size() - i)));
+            }
+            
+            p_ring->queueFsync(m_fd);
+            
+            if (!p_ring->submitAndWait())
+            {
+                throw typename Exception::ErrorWritingToFile();
+            }
+        }
+        else
+        {
+            for (auto p_buffer : in_buffers)
+            {
+                write(*p_buffer);
+            }
+            
+            if (fsync(m_fd) < 0)
+            {
+                throw typename Exception::ErrorWritingToFile();
+            }
+        }
+        
+        m_synced = true;
+    }
+    else
+    {
+        perror("Error write flag not set in File instance");
+        
+        exit(EXIT_FAILURE);
+    }
+}
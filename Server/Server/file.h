@@ -15,6 +15,7 @@
 #define file_h
 
 #include <string>
+#include <vector>
 
 namespace EmersonClientServerFileSystem
 {
@@ -25,10 +26,15 @@ namespace EmersonClientServerFileSystem
         
         using string = std::string;
         
+        template<class T>
+        using vector = std::vector<T>;
+        
         int m_fd;
         
         int m_flags;
         
+        bool m_synced = false;
+        
     public:
         
         File(const string& in_file_path, int in_flags);
@@ -45,6 +51,11 @@ namespace EmersonClientServerFileSystem
         
         void write(const string& in_buffer_str);
         
+        // Note: Writes every buffer in order and then flushes the file to disk before returning.
+        //       With an IoRing available the writes and fsync are submitted together as one
+        //       linked batch, otherwise each is issued as its own system call.
+        void writeAndSync(const vector<const string *>& in_buffers);
+        
     };
 }
 
@@ -0,0 +1,139 @@
+//
+//  group-commit.cpp
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+
+#include <unordered_map>
+
+#include <fcntl.h>
+
+#include "exceptions.h"
+#include "file.h"
+#include "group-commit.h"
+
+using namespace EmersonClientServerFileSystem;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public Member Functions                                                                        //
+// ↓                                                                                            ↓ //
+
+GroupCommit::GroupCommit(microseconds in_window, size_t in_max_bytes) : m_window(in_window), m_max_bytes(in_max_bytes) {}
+
+bool GroupCommit::append(const string& in_log_path, const string& in_record)
+{
+    Participant participant{in_log_path, in_record};
+    
+    unique_lock<mutex> group_lck(m_mtx);
+    
+    m_group.push_back(&participant);
+    
+    m_group_bytes += in_record.length();
+    
+    if (m_group_bytes >= m_max_bytes)
+    {
+        m_cv.notify_all(); // the leader stops waiting for more participants
+    }
+    
+    while (!participant.m_done)
+    {
+        if (m_flushing || !(&participant == m_group.front()))
+        {
+            m_cv.wait(group_lck);
+            
+            continue;
+        }
+        
+        // Note: The participant at the front of a group that is not being flushed leads it.
+        m_flushing = true;
+        
+        if (m_concurrent)
+        {
+            m_cv.wait_for(group_lck, m_window, [this]() { return m_group_bytes >= m_max_bytes; });
+        }
+        
+        vector<Participant *> group;
+        
+        group.swap(m_group);
+        
+        m_group_bytes = 0;
+        
+        m_concurrent = group.size() > 1;
+        
+        group_lck.unlock();
+        
+        flush(group);
+        
+        group_lck.lock();
+        
+        for (auto p_participant : group)
+        {
+            p_participant->m_done = true;
+        }
+        
+        m_flushing = false;
+        
+        m_cv.notify_all();
+    }
+    
+    return participant.m_written;
+}
+
+// ↑                                                                                            ↑ //
+// Public Member Functions                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Private Member Functions                                                                       //
+// ↓                                                                                            ↓ //
+
+void GroupCommit::flush(const vector<Participant *>& in_group)
+{
+    // records are kept in the order they joined the group within each log file
+    std::unordered_map<string, vector<Participant *>> log_path_to_participants;
+    
+    for (auto p_participant : in_group)
+    {
+        log_path_to_participants[p_participant->m_log_path].push_back(p_participant);
+    }
+    
+    for (const auto& [log_path, participants] : log_path_to_participants)
+    {
+        vector<const string *> records;
+        
+        records.reserve(participants.size());
+        
+        for (auto p_participant : participants)
+        {
+            records.push_back(&p_participant->m_record);
+        }
+        
+        bool written = true;
+        
+        try
+        {
+            File log(log_path, O_CREAT | O_WRONLY | O_APPEND);
+            
+            log.writeAndSync(records);
+        }
+        catch (Exception::ErrorOpeningFile)
+        {
+            written = false;
+        }
+        catch (Exception::ErrorWritingToFile)
+        {
+            written = false;
+        }
+        
+        for (auto p_participant : participants)
+        {
+            p_participant->m_written = written;
+        }
+    }
+}
+
+// ↑                                                                                            ↑ //
+// Private Member Functions                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////
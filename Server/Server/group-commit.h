@@ -0,0 +1,101 @@
+//
+//  group-commit.h
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The GroupCommit class makes log records durable in groups. A thread appending a record joins   //
+// the group currently forming, and the first thread to join becomes its leader. The leader       //
+// writes the records of every thread in the group with one write and one fsync per log file and  //
+// then wakes them all, so threads logging at the same time share the cost of an fsync rather     //
+// than queueing for one each. Threads that join while a group is being flushed form the next     //
+// group, whose leader is chosen once the flush completes.                                        //
+//                                                                                                //
+// Note: A leader waits up to the window for more threads to join, but only once the previous     //
+//       group had more than one thread in it, so a server logging one record at a time does not  //
+//       pay for the window. The group is flushed early once its records reach the byte limit.    //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef group_commit_h
+#define group_commit_h
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace EmersonClientServerFileSystem
+{
+    class GroupCommit
+    {
+        
+    public:
+        
+        using microseconds = std::chrono::microseconds;
+        
+    private:
+        
+        using condition_variable = std::condition_variable;
+        
+        using mutex = std::mutex;
+        
+        using string = std::string;
+        
+        template<class T>
+        using unique_lock = std::unique_lock<T>;
+        
+        template<class T>
+        using vector = std::vector<T>;
+        
+        // Note: A Participant lives on the stack of the thread appending it, which waits until
+        //       m_done is set before returning.
+        struct Participant
+        {
+            const string& m_log_path;
+            const string& m_record;
+            bool m_done = false;
+            bool m_written = false;
+        };
+        
+        const microseconds m_window;
+        
+        const size_t m_max_bytes;
+        
+        vector<Participant *> m_group; // the group currently forming
+        
+        size_t m_group_bytes = 0;
+        
+        bool m_flushing = false;
+        
+        bool m_concurrent = false; // whether the previous group had more than one participant
+        
+        mutex m_mtx;
+        
+        condition_variable m_cv;
+        
+        // writes the records of in_group to their log files, syncing each file once, and sets
+        // whether each participant's record was written
+        static void flush(const vector<Participant *>& in_group);
+        
+    public:
+        
+        // ctor in_window is how long a leader waits for more threads to join its group
+        GroupCommit(microseconds in_window, size_t in_max_bytes);
+        
+        GroupCommit(const GroupCommit&) = delete;
+        
+        GroupCommit& operator=(const GroupCommit&) = delete;
+        
+        // appends in_record to the log file at in_log_path, together with the records of every
+        // other thread appending at about the same time, and returns once it is on disk, or
+        // false if it could not be written
+        bool append(const string& in_log_path, const string& in_record);
+        
+    };
+}
+
+#endif /* group_commit_h */
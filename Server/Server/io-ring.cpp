@@ -0,0 +1,340 @@
+//
+//  io-ring.cpp
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "io-ring.h"
+
+using namespace EmersonClientServerFileSystem;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public Member Functions                                                                        //
+// ↓                                                                                            ↓ //
+
+IoRing::~IoRing()
+{
+#ifdef IO_RING_SUPPORTED
+    if (m_p_sqes)
+    {
+        munmap(m_p_sqes, m_sqes_size);
+    }
+    
+    if (m_p_cq_ring && !(m_p_cq_ring == m_p_sq_ring))
+    {
+        munmap(m_p_cq_ring, m_cq_ring_size);
+    }
+    
+    if (m_p_sq_ring)
+    {
+        munmap(m_p_sq_ring, m_sq_ring_size);
+    }
+#endif
+    
+    if (m_ring_fd >= 0)
+    {
+        close(m_ring_fd);
+    }
+}
+
+IoRing * IoRing::getThreadRing()
+{
+#ifdef IO_RING_SUPPORTED
+    if (!Constants::use_io_uring)
+    {
+        return nullptr;
+    }
+    
+    thread_local std::unique_ptr<IoRing> up_ring(new IoRing());
+    
+    return up_ring->m_ring_fd < 0 || up_ring->m_unusable ? nullptr : up_ring.get();
+#else
+    return nullptr;
+#endif
+}
+
+void IoRing::queueWritev(int in_fd, const struct iovec * in_iov, int in_iovcnt)
+{
+#ifdef IO_RING_SUPPORTED
+    long long expected_result = 0;
+    
+    for (int i = 0; i < in_iovcnt; ++i)
+    {
+        expected_result += in_iov[i].iov_len;
+    }
+    
+    auto p_sqe = getSubmissionQueueEntry(expected_result);
+    
+    p_sqe->opcode = IORING_OP_WRITEV;
+    
+    p_sqe->fd = in_fd;
+    
+    p_sqe->addr = reinterpret_cast<unsigned long long>(in_iov);
+    
+    p_sqe->len = in_iovcnt;
+    
+    p_sqe->off = static_cast<unsigned long long>(-1); // use (and advance) the file offset
+#endif
+}
+
+void IoRing::queueFsync(int in_fd)
+{
+#ifdef IO_RING_SUPPORTED
+    auto p_sqe = getSubmissionQueueEntry(0);
+    
+    p_sqe->opcode = IORING_OP_FSYNC;
+    
+    p_sqe->fd = in_fd;
+#endif
+}
+
+bool IoRing::submitAndWait()
+{
+#ifdef IO_RING_SUPPORTED
+    unsigned num_queued = static_cast<unsigned>(m_expected_results.size());
+    
+    if (0 == num_queued || m_unusable)
+    {
+        m_expected_results.clear();
+        
+        m_p_last_sqe = nullptr;
+        
+        bool succeeded = !m_failed && !m_unusable;
+        
+        m_failed = false;
+        
+        return succeeded;
+    }
+    
+    unsigned sq_head = __atomic_load_n(m_p_sq_head, __ATOMIC_ACQUIRE);
+    
+    // publish the queued entries to the kernel
+    __atomic_store_n(m_p_sq_tail, *m_p_sq_tail + num_queued, __ATOMIC_RELEASE);
+    
+    unsigned num_completed = 0;
+    
+    unsigned num_submitted = num_queued;
+    
+    while (num_completed < num_queued)
+    {
+        long rv = syscall(__NR_io_uring_enter, m_ring_fd, num_submitted, num_queued - num_completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+        
+        if (rv < 0 && !(EINTR == errno))
+        {
+            abandon(sq_head, num_completed + reapCompletions());
+            
+            break;
+        }
+        
+        num_submitted = 0;
+        
+        num_completed += reapCompletions();
+    }
+    
+    m_expected_results.clear();
+    
+    m_p_last_sqe = nullptr;
+    
+    bool succeeded = !m_failed;
+    
+    m_failed = false;
+    
+    return succeeded;
+#else
+    return false;
+#endif
+}
+
+// ↑                                                                                            ↑ //
+// Public Member Functions                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Private Member Functions                                                                       //
+// ↓                                                                                            ↓ //
+
+IoRing::IoRing()
+{
+#ifdef IO_RING_SUPPORTED
+    struct io_uring_params params;
+    
+    memset(&params, 0, sizeof(params));
+    
+    int ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, s_num_entries, &params));
+    
+    if (ring_fd < 0)
+    {
+        return;
+    }
+    
+    // writes at the current file offset are required to append with IORING_OP_WRITEV
+    if (!(IORING_FEAT_RW_CUR_POS & params.features))
+    {
+        close(ring_fd);
+        
+        return;
+    }
+    
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    
+    bool single_mmap = IORING_FEAT_SINGLE_MMAP & params.features;
+    
+    if (single_mmap)
+    {
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+    
+    m_p_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    
+    m_p_cq_ring = single_mmap ? m_p_sq_ring : mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    
+    void * p_sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    
+    if (MAP_FAILED == m_p_sq_ring || MAP_FAILED == m_p_cq_ring || MAP_FAILED == p_sqes)
+    {
+        m_p_sq_ring = MAP_FAILED == m_p_sq_ring ? nullptr : m_p_sq_ring;
+        
+        m_p_cq_ring = MAP_FAILED == m_p_cq_ring ? nullptr : m_p_cq_ring;
+        
+        m_p_sqes = MAP_FAILED == p_sqes ? nullptr : static_cast<struct io_uring_sqe *>(p_sqes);
+        
+        close(ring_fd);
+        
+        return;
+    }
+    
+    auto p_sq_ring = static_cast<char *>(m_p_sq_ring);
+    
+    auto p_cq_ring = static_cast<char *>(m_p_cq_ring);
+    
+    m_p_sq_tail = reinterpret_cast<unsigned *>(p_sq_ring + params.sq_off.tail);
+    
+    m_p_sq_mask = reinterpret_cast<unsigned *>(p_sq_ring + params.sq_off.ring_mask);
+    
+    m_p_sq_array = reinterpret_cast<unsigned *>(p_sq_ring + params.sq_off.array);
+    
+    m_p_cq_head = reinterpret_cast<unsigned *>(p_cq_ring + params.cq_off.head);
+    
+    m_p_cq_tail = reinterpret_cast<unsigned *>(p_cq_ring + params.cq_off.tail);
+    
+    m_p_cq_mask = reinterpret_cast<unsigned *>(p_cq_ring + params.cq_off.ring_mask);
+    
+    m_p_cqes = reinterpret_cast<struct io_uring_cqe *>(p_cq_ring + params.cq_off.cqes);
+    
+    m_p_sqes = static_cast<struct io_uring_sqe *>(p_sqes);
+    
+    m_p_sq_head = reinterpret_cast<unsigned *>(p_sq_ring + params.sq_off.head);
+    
+    m_sq_entries = params.sq_entries;
+    
+    m_ring_fd = ring_fd;
+#endif
+}
+
+#ifdef IO_RING_SUPPORTED
+struct io_uring_sqe * IoRing::getSubmissionQueueEntry(long long in_expected_result)
+{
+    if (m_expected_results.size() == m_sq_entries)
+    {
+        // Note: The chain is split across submissions here, which preserves ordering as the
+        //       first half has completed before the second half is submitted.
+        if (!submitAndWait())
+        {
+            m_failed = true;
+        }
+    }
+    
+    if (m_p_last_sqe)
+    {
+        m_p_last_sqe->flags |= IOSQE_IO_LINK;
+    }
+    
+    unsigned index = (*m_p_sq_tail + static_cast<unsigned>(m_expected_results.size())) & *m_p_sq_mask;
+    
+    auto p_sqe = &m_p_sqes[index];
+    
+    memset(p_sqe, 0, sizeof(*p_sqe));
+    
+    p_sqe->user_data = m_expected_results.size();
+    
+    m_p_sq_array[index] = index;
+    
+    m_expected_results.push_back(in_expected_result);
+    
+    m_p_last_sqe = p_sqe;
+    
+    return p_sqe;
+}
+
+unsigned IoRing::reapCompletions()
+{
+    unsigned num_completed = 0;
+    
+    unsigned cq_head = *m_p_cq_head;
+    
+    unsigned cq_tail = __atomic_load_n(m_p_cq_tail, __ATOMIC_ACQUIRE);
+    
+    for (; !(cq_head == cq_tail); ++cq_head, ++num_completed)
+    {
+        const auto& cqe = m_p_cqes[cq_head & *m_p_cq_mask];
+        
+        if (cqe.user_data >= m_expected_results.size() || !(m_expected_results[cqe.user_data] == cqe.res))
+        {
+            m_failed = true; // error, short write, or cancelled because an earlier link failed
+        }
+    }
+    
+    __atomic_store_n(m_p_cq_head, cq_head, __ATOMIC_RELEASE);
+    
+    return num_completed;
+}
+
+void IoRing::abandon(unsigned in_sq_head, unsigned in_num_completed)
+{
+    m_failed = true;
+    
+    m_unusable = true;
+    
+    // Note: Without SQPOLL the kernel only reads the submission queue inside io_uring_enter, so
+    //       entries past its head can be withdrawn by moving the tail back to it.
+    unsigned sq_head = __atomic_load_n(m_p_sq_head, __ATOMIC_ACQUIRE);
+    
+    __atomic_store_n(m_p_sq_tail, sq_head, __ATOMIC_RELEASE);
+    
+    unsigned num_consumed = sq_head - in_sq_head;
+    
+    for (unsigned num_completed = in_num_completed; num_completed < num_consumed; num_completed += reapCompletions())
+    {
+        if (syscall(__NR_io_uring_enter, m_ring_fd, 0, num_consumed - num_completed, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && !(EINTR == errno || EAGAIN == errno || EBUSY == errno))
+        {
+            // the buffers of the operations in flight cannot be released while the kernel may
+            // still access them
+            perror("Error waiting for io_uring completions");
+            
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+#endif
+
+// ↑                                                                                            ↑ //
+// Private Member Functions                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////
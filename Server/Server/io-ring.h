@@ -0,0 +1,140 @@
+//
+//  io-ring.h
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The IoRing class is a minimal wrapper around a Linux io_uring submission/completion queue      //
+// pair. Operations are queued as submission queue entries and then submitted and waited on       //
+// together with a single io_uring_enter system call, so a batch of writes followed by an fsync   //
+// costs one system call rather than one per operation.                                           //
+//                                                                                                //
+// Note: Each thread gets its own IoRing (see getThreadRing) so rings are never shared and need   //
+//       no locking. As the ServerDispatcher sizes its ThreadPool to the number of cores, this    //
+//       amounts to one ring per core.                                                            //
+//                                                                                                //
+// Note: getThreadRing returns nullptr if io_uring is disabled in Constants, is not supported by  //
+//       the platform, or cannot be set up (e.g. older kernels or seccomp policies), in which     //
+//       case callers fall back to ordinary blocking system calls.                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef io_ring_h
+#define io_ring_h
+
+#include <vector>
+
+#include <sys/uio.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define IO_RING_SUPPORTED 1
+#include <linux/io_uring.h>
+#endif
+
+namespace EmersonClientServerFileSystem
+{
+    class IoRing
+    {
+        
+    private:
+        
+        template<class T>
+        using vector = std::vector<T>;
+        
+        static const unsigned s_num_entries = 64;
+        
+        int m_ring_fd = -1;
+        
+#ifdef IO_RING_SUPPORTED
+        void * m_p_sq_ring = nullptr;
+        
+        size_t m_sq_ring_size = 0;
+        
+        void * m_p_cq_ring = nullptr;
+        
+        size_t m_cq_ring_size = 0;
+        
+        struct io_uring_sqe * m_p_sqes = nullptr;
+        
+        size_t m_sqes_size = 0;
+        
+        unsigned * m_p_sq_head = nullptr;
+        
+        unsigned * m_p_sq_tail = nullptr;
+        
+        unsigned * m_p_sq_mask = nullptr;
+        
+        unsigned * m_p_sq_array = nullptr;
+        
+        unsigned * m_p_cq_head = nullptr;
+        
+        unsigned * m_p_cq_tail = nullptr;
+        
+        unsigned * m_p_cq_mask = nullptr;
+        
+        struct io_uring_cqe * m_p_cqes = nullptr;
+        
+        unsigned m_sq_entries = 0;
+        
+        struct io_uring_sqe * m_p_last_sqe = nullptr;
+#endif
+        
+        // expected result of each queued operation, indexed by user_data
+        vector<long long> m_expected_results;
+        
+        bool m_failed = false;
+        
+        // set once io_uring_enter fails, after which the thread writes with system calls instead
+        bool m_unusable = false;
+        
+        IoRing();
+        
+#ifdef IO_RING_SUPPORTED
+        // returns a zeroed entry linked after the previously queued entry, submitting the queue
+        // first if it is full
+        struct io_uring_sqe * getSubmissionQueueEntry(long long in_expected_result);
+        
+        // consumes every completion posted so far, setting m_failed if any operation did not
+        // complete in full, and returns how many were consumed
+        unsigned reapCompletions();
+        
+        // Note: The kernel may still be reading the callers' buffers for entries it has already
+        //       taken from the submission queue, so they are waited for before the ring is given
+        //       up, and entries it has not taken are removed so no later submission sends them.
+        //
+        // waits for the entries submitted since in_sq_head, out of the in_num_completed already
+        // reaped, and marks the ring unusable
+        void abandon(unsigned in_sq_head, unsigned in_num_completed);
+#endif
+        
+    public:
+        
+        ~IoRing();
+        
+        IoRing(const IoRing&) = delete;
+        
+        IoRing& operator=(const IoRing&) = delete;
+        
+        // returns the calling thread's ring, or nullptr if io_uring is unavailable
+        static IoRing * getThreadRing();
+        
+        // Note: Queued operations are linked so each one only starts once every operation queued
+        //       before it has completed successfully, which keeps appends in order and ensures an
+        //       fsync covers the writes queued ahead of it.
+        //
+        // queues a write of in_iovcnt buffers at the file's current offset (i.e. appends when
+        // in_fd was opened with O_APPEND)
+        void queueWritev(int in_fd, const struct iovec * in_iov, int in_iovcnt);
+        
+        // queues an fsync of in_fd
+        void queueFsync(int in_fd);
+        
+        // submits all queued operations with a single system call, waits for all of them to
+        // complete, and returns true if every operation completed in full
+        bool submitAndWait();
+        
+    };
+}
+
+#endif /* io_ring_h */
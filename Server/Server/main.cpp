@@ -10,8 +10,6 @@
 
 // TODO: mark methods that are const const same with noexcept
 
-#include <mutex>
-
 #include "argument-helper.h"
 #include "server.h"
 #include "signal-handler.h"
@@ -20,14 +18,10 @@ using std::stoi;
 
 using std::string;
 
-std::mutex g_mtx;
-
 using namespace EmersonClientServerFileSystem;
 
 int main(int argc, char *argv[])
 {
-    srand(static_cast<unsigned int>(time(nullptr)));
-    
     if (3 >= argc || ArgumentHelper::hasHelpArgument(argc, argv))
     {
         ArgumentHelper::printServerHelpMessage();
@@ -40,7 +34,9 @@ int main(int argc, char *argv[])
         
         string server_directory;
         
-        std::unordered_map<string, string&> supported_arguments{{ArgumentHelper::server_ipv4_addr_arg_prefix, server_ipv4_addr}, {ArgumentHelper::server_port_arg_prefix, server_port}, {ArgumentHelper::server_directory_arg_prefix, server_directory}};
+        string server_unix_path;
+        
+        std::unordered_map<string, string&> supported_arguments{{ArgumentHelper::server_ipv4_addr_arg_prefix, server_ipv4_addr}, {ArgumentHelper::server_port_arg_prefix, server_port}, {ArgumentHelper::server_directory_arg_prefix, server_directory}, {ArgumentHelper::server_unix_path_arg_prefix, server_unix_path}};
         
         ArgumentHelper::extractArguments(argc, argv, supported_arguments);
         
@@ -50,9 +46,14 @@ int main(int argc, char *argv[])
         
         ArgumentHelper::validateDirectory(server_directory);
         
+        if (!server_unix_path.empty()) // if optional unix path argument specified, validate it
+        {
+            ArgumentHelper::validateUnixPath(server_unix_path);
+        }
+        
         SignalHandler signal_handler(server_directory);
         
-        Server server(server_ipv4_addr, stoi(server_port), server_directory);
+        Server server(server_ipv4_addr, stoi(server_port), server_directory, server_unix_path);
         
         server.start();
     }
@@ -0,0 +1,181 @@
+//
+//  sequence-buffer.cpp
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+
+#include <algorithm>
+#include <cassert>
+
+#include "sequence-buffer.h"
+
+using namespace EmersonClientServerFileSystem;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public Member Functions                                                                        //
+// ↓                                                                                            ↓ //
+
+bool SequenceBuffer::isInRange(SeqNum in_seq_num)
+{
+    return in_seq_num >= s_first_seq_num && in_seq_num <= Constants::max_seq_num;
+}
+
+bool SequenceBuffer::contains(SeqNum in_seq_num) const
+{
+    if (!isInRange(in_seq_num))
+    {
+        return false;
+    }
+    
+    size_t index = in_seq_num - s_first_seq_num;
+    
+    return index / s_word_bits < m_received.size() && (m_received[index / s_word_bits] >> (index % s_word_bits) & 1);
+}
+
+bool SequenceBuffer::insert(SeqNum in_seq_num, Data&& in_data)
+{
+    if (!isInRange(in_seq_num) || contains(in_seq_num))
+    {
+        return false;
+    }
+    
+    reserveSlot(in_seq_num) = std::move(in_data);
+    
+    size_t index = in_seq_num - s_first_seq_num;
+    
+    m_received[index / s_word_bits] |= uint64_t(1) << (index % s_word_bits);
+    
+    return true;
+}
+
+bool SequenceBuffer::insert(SeqNum in_seq_num, string_view in_data)
+{
+    if (!isInRange(in_seq_num) || contains(in_seq_num))
+    {
+        return false;
+    }
+    
+    reserveSlot(in_seq_num).assign(in_data);
+    
+    size_t index = in_seq_num - s_first_seq_num;
+    
+    m_received[index / s_word_bits] |= uint64_t(1) << (index % s_word_bits);
+    
+    return true;
+}
+
+SequenceBuffer::SeqNum SequenceBuffer::findFirstMissing(SeqNum in_max_seq_num) const
+{
+    size_t end_index = static_cast<size_t>(std::max(in_max_seq_num - s_first_seq_num + 1, 0));
+    
+    return static_cast<SeqNum>(findNextIndex(0, end_index, false)) + s_first_seq_num;
+}
+
+SequenceBuffer::vector<SequenceBuffer::SeqNumRange> SequenceBuffer::getMissingRanges(SeqNum in_first_seq_num, SeqNum in_max_seq_num) const
+{
+    vector<SeqNumRange> missing_ranges;
+    
+    size_t end_index = static_cast<size_t>(std::max(in_max_seq_num - s_first_seq_num + 1, 0));
+    
+    // Note: Each run is found with two scans, one for its first missing sequence number and one
+    //       for the next received after it, so runs of received sequence numbers are skipped a
+    //       word at a time.
+    for (size_t index = findNextIndex(static_cast<size_t>(std::max(in_first_seq_num - s_first_seq_num, 0)), end_index, false); index < end_index; index = findNextIndex(index, end_index, false))
+    {
+        size_t next_index = findNextIndex(index, end_index, true);
+        
+        missing_ranges.emplace_back(static_cast<SeqNum>(index) + s_first_seq_num, static_cast<SeqNum>(next_index - 1) + s_first_seq_num);
+        
+        index = next_index;
+    }
+    
+    return missing_ranges;
+}
+
+SequenceBuffer::vector<const SequenceBuffer::Data *> SequenceBuffer::getOrderedBuffers(SeqNum in_max_seq_num) const
+{
+    assert(findFirstMissing(in_max_seq_num) > in_max_seq_num);
+    
+    vector<const Data *> ordered_buffers;
+    
+    if (in_max_seq_num < s_first_seq_num)
+    {
+        return ordered_buffers;
+    }
+    
+    ordered_buffers.reserve(in_max_seq_num - s_first_seq_num + 1);
+    
+    for (size_t index = 0, end_index = in_max_seq_num - s_first_seq_num + 1; index < end_index; ++index)
+    {
+        ordered_buffers.push_back(&(*m_pages[index / s_page_slots])[index % s_page_slots]);
+    }
+    
+    return ordered_buffers;
+}
+
+// ↑                                                                                            ↑ //
+// Public Member Functions                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Private Member Functions                                                                       //
+// ↓                                                                                            ↓ //
+
+size_t SequenceBuffer::findNextIndex(size_t in_index, size_t in_end, bool in_received) const
+{
+    // Note: Bits past the end of the bitmap are clear, so a scan for a clear bit that reaches the
+    //       end has found one while a scan for a set bit has not.
+    for (size_t word = in_index / s_word_bits; in_index < in_end; ++word, in_index = word * s_word_bits)
+    {
+        if (word >= m_received.size())
+        {
+            return in_received ? in_end : in_index;
+        }
+        
+        uint64_t bits = (in_received ? m_received[word] : ~m_received[word]) >> (in_index % s_word_bits);
+        
+        if (bits)
+        {
+            return std::min(in_index + __builtin_ctzll(bits), in_end);
+        }
+    }
+    
+    return in_end;
+}
+
+SequenceBuffer::Data& SequenceBuffer::reserveSlot(SeqNum in_seq_num)
+{
+    size_t index = in_seq_num - s_first_seq_num;
+    
+    size_t page = index / s_page_slots;
+    
+    if (page >= m_pages.size())
+    {
+        // Note: Capacity is doubled explicitly so that writes arriving in order of sequence
+        //       number grow the page table in amortized constant time.
+        if (page >= m_pages.capacity())
+        {
+            m_pages.reserve(std::max(page + 1, 2 * m_pages.capacity()));
+        }
+        
+        m_pages.resize(page + 1);
+    }
+    
+    if (index / s_word_bits >= m_received.size())
+    {
+        m_received.resize(index / s_word_bits + 1, 0);
+    }
+    
+    if (!m_pages[page])
+    {
+        m_pages[page] = std::make_unique<Page>();
+    }
+    
+    return (*m_pages[page])[index % s_page_slots];
+}
+
+// ↑                                                                                            ↑ //
+// Private Member Functions                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,107 @@
+//
+//  sequence-buffer.h
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The SequenceBuffer class holds the data written to a transaction, indexed by sequence number.  //
+// The data of each sequence number is kept in fixed size pages at the offset of its sequence     //
+// number, alongside a bitmap with a bit set for each sequence number received. A gap is found by //
+// scanning the bitmap a word at a time for the first zero bit, and the data is retrieved in      //
+// order of sequence number with a single pass over the pages.                                    //
+//                                                                                                //
+// Note: A page is only allocated once a sequence number within it is received, so a sequence     //
+//       number far ahead of the others costs one page rather than a slot for every sequence      //
+//       number before it. The page table and the bitmap still grow to the highest sequence       //
+//       number received, a pointer and a bit per page and sequence number respectively, so       //
+//       sequence numbers are bounded by Constants::max_seq_num to bound them.                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef sequence_buffer_h
+#define sequence_buffer_h
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+
+namespace EmersonClientServerFileSystem
+{
+    class SequenceBuffer
+    {
+        
+    public:
+        
+        using SeqNum = int;
+        
+        using Data = std::string;
+        
+        using SeqNumRange = std::pair<SeqNum, SeqNum>; // first and last sequence number of a run
+        
+        static constexpr SeqNum s_first_seq_num = Constants::initial_seq_num + 1;
+        
+    private:
+        
+        using string_view = std::string_view;
+        
+        template<class T>
+        using vector = std::vector<T>;
+        
+        static constexpr size_t s_word_bits = 64;
+        
+        static constexpr size_t s_page_slots = 256;
+        
+        using Page = std::array<Data, s_page_slots>;
+        
+        // data of sequence number s_first_seq_num + i at index i % s_page_slots of page
+        // i / s_page_slots, pages holding no data being null
+        vector<std::unique_ptr<Page>> m_pages;
+        
+        vector<uint64_t> m_received; // bit i set once sequence number s_first_seq_num + i is received
+        
+        // returns the first index from in_index up to in_end whose bit is set if in_received and
+        // clear otherwise, or in_end if there is none
+        size_t findNextIndex(size_t in_index, size_t in_end, bool in_received) const;
+        
+        // returns the slot of in_seq_num, growing the page table and bitmap to include it and
+        // allocating its page
+        Data& reserveSlot(SeqNum in_seq_num);
+        
+    public:
+        
+        // returns true if in_seq_num can be held by a SequenceBuffer
+        static bool isInRange(SeqNum in_seq_num);
+        
+        bool contains(SeqNum in_seq_num) const;
+        
+        // returns false if in_seq_num is out of range or has already been received, otherwise
+        // stores in_data as its data
+        bool insert(SeqNum in_seq_num, Data&& in_data);
+        
+        bool insert(SeqNum in_seq_num, string_view in_data);
+        
+        // returns the lowest sequence number up to in_max_seq_num that has not been received, or
+        // in_max_seq_num + 1 if every one of them has
+        SeqNum findFirstMissing(SeqNum in_max_seq_num) const;
+        
+        // returns each run of consecutive sequence numbers from in_first_seq_num up to
+        // in_max_seq_num that have not been received, in order
+        vector<SeqNumRange> getMissingRanges(SeqNum in_first_seq_num, SeqNum in_max_seq_num) const;
+        
+        // Note: Every sequence number up to in_max_seq_num must have been received.
+        //
+        // returns the data of each sequence number up to in_max_seq_num in order
+        vector<const Data *> getOrderedBuffers(SeqNum in_max_seq_num) const;
+        
+    };
+}
+
+#endif /* sequence_buffer_h */
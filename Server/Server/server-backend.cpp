@@ -6,6 +6,10 @@
 //  Copyright © 2019 Emerson Dolinski. All rights reserved.
 //
 
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #ifdef DEBUG
 #include <iostream>
@@ -20,72 +24,159 @@
 #include "constants.h"
 #include "exceptions.h"
 #include "server-backend.h"
+#include "write-batch.h"
 
-#define COMMAND_FUNCTION_PARAMS [this](const RequestTuple& in_client_request_tuple, string& out_server_response_str, bool& out_transaction_in_progress)
+#define COMMAND_FUNCTION_PARAMS [this](const Session& in_session, const RequestTuple& in_client_request_tuple, Response& out_server_response, bool& out_transaction_in_progress)
 #define NOW high_resolution_clock::now()
-#define START_TRANSACTION_TIMER() thread(m_txn_timer_function, in_txn_id, curr_timestamp, move(in_file_name)).detach()
-#define SET_RESPONSE_3(command, txn_id, seq_num) out_server_response_str = generateResponse(command, txn_id, seq_num)
-#define SET_RESPONSE_5(command, txn_id, seq_num, error, data) out_server_response_str = generateResponse(command, txn_id, seq_num, error, data)
+#define SET_RESPONSE_3(command, txn_id, seq_num) out_server_response = generateResponse(in_session, command, txn_id, seq_num)
+#define SET_RESPONSE_5(command, txn_id, seq_num, error, data) out_server_response = generateResponse(in_session, command, txn_id, seq_num, error, data)
 #define SET_ERROR_AND_RETURN(error) out_transaction_in_progress = false; SET_RESPONSE_5(Constants::error_cmd, txn_id, seq_num, error, Errors::getErrorMessage(error)); return
 #define SET_FORMATTING_ERROR() out_transaction_in_progress = false; SET_RESPONSE_5(Constants::error_cmd, Constants::default_txn_id, Constants::error_seq_num, Errors::InvalidMessageFormat, Errors::getErrorMessage(Errors::InvalidMessageFormat))
 #define SET_ACK_AND_RETURN() SET_RESPONSE_3(Constants::ack_cmd, txn_id, seq_num); return
 #define SET_NEW_TXN_AND_RETURN(txn_id) SET_RESPONSE_3(Constants::ack_cmd, txn_id, Constants::initial_seq_num); return
 #define SET_READ_AND_RETURN(buffer) SET_RESPONSE_5(Constants::ack_cmd, txn_id, seq_num, Errors::nil, buffer); return
-#define SET_ASK_RESEND_AND_RETURN(seq_num) SET_RESPONSE_3(Constants::ask_resend_cmd, txn_id, seq_num); return
-#define RETURN_IF_INVALID_ID() if (0 == m_txn_id_to_transaction_attributes.count(txn_id)) { SET_ERROR_AND_RETURN(Errors::InvalidTransactionId); }
-#define RETURN_ERROR_IF_ABORTED() if (0 == m_txn_id_to_transaction_attributes.count(txn_id)) { SET_ERROR_AND_RETURN(Errors::TransactionAborted); }
-#define RETURN_ERROR_IF_COMMITTED(error) if (m_commits.count(txn_id)) { SET_ERROR_AND_RETURN(error); }
+#define SET_CHECKSUMMED_READ_AND_RETURN(buffer, checksum) out_server_response = generateResponse(in_session, Constants::ack_cmd, txn_id, seq_num, Errors::nil, buffer, checksum); return
+#define SET_BATCH_ACK_AND_RETURN(num_accepted, ranges) SET_RESPONSE_5(Constants::ack_cmd, txn_id, num_accepted, Errors::nil, ranges); return
+#define SET_ASK_RESEND_AND_RETURN(seq_num, ranges) SET_RESPONSE_5(Constants::ask_resend_cmd, txn_id, seq_num, Errors::nil, ranges); return
+#define SET_NACK_AND_RETURN(ranges) SET_RESPONSE_5(Constants::ack_cmd, txn_id, seq_num, Errors::nil, ranges); return
+#define RETURN_IF_INVALID_ID() if (0 == shard.m_txn_id_to_transaction_attributes.count(txn_id)) { SET_ERROR_AND_RETURN(Errors::InvalidTransactionId); }
+#define RETURN_ERROR_IF_ABORTED() if (0 == shard.m_txn_id_to_transaction_attributes.count(txn_id)) { SET_ERROR_AND_RETURN(Errors::TransactionAborted); }
+#define RETURN_ERROR_IF_COMMITTED(error) if (shard.m_commits.count(txn_id)) { SET_ERROR_AND_RETURN(error); }
 #define RETURN_ERROR_IF_COMMITTED_OR_INVALID_ID() RETURN_ERROR_IF_COMMITTED(Errors::InvalidOperation); RETURN_IF_INVALID_ID()
 #define RETURN_ERROR_IF_COMMITTED_OR_ABORTED() RETURN_ERROR_IF_COMMITTED(Errors::TransactionAlreadyCommitted); RETURN_ERROR_IF_ABORTED()
-#define RETURN_ACK_IF_COMMITTED() if (m_commits.count(txn_id)) { SET_ACK_AND_RETURN(); }
+#define RETURN_ACK_IF_COMMITTED() if (shard.m_commits.count(txn_id)) { SET_ACK_AND_RETURN(); }
 #define RETURN_ACK_IF_COMMITTED_OR_ERROR_IF_INVALID_ID() RETURN_ACK_IF_COMMITTED(); RETURN_IF_INVALID_ID()
 
-#ifdef DEBUG
-extern std::mutex g_mtx;
-#endif
-
 using namespace EmersonClientServerFileSystem;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Public Member Functions                                                                        //
 // ↓                                                                                            ↓ //
 
-ServerBackend::ServerBackend(string in_directory) : m_directory(!in_directory.empty() && !('/' == in_directory.back()) ? move(in_directory) + '/' : move(in_directory))
+ServerBackend::ServerBackend(string in_directory, TimerWheel& io_timer_wheel, int in_num_shards) : m_timer_wheel(io_timer_wheel), m_directory(!in_directory.empty() && !('/' == in_directory.back()) ? move(in_directory) + '/' : move(in_directory)), m_txn_id_allocator(m_directory + m_epoch_file), m_group_commit(GroupCommit::microseconds(Constants::group_commit_window_microseconds), Constants::group_commit_max_bytes), m_timeout_pool(1)
 {
+    int num_shards = in_num_shards > 0 ? in_num_shards : max(1, static_cast<int>(thread::hardware_concurrency()));
+    
+    // a transaction id only has room for so many shard indices
+    num_shards = std::min(num_shards, static_cast<int>(TransactionIdAllocator::s_max_shards));
+    
+    for (int i = 0; i < num_shards; ++i)
+    {
+        m_shards.push_back(make_unique<Shard>());
+    }
+    
+    initializeResponseTemplates();
+    
     // TODO: initialize functions in ctor (Note: this is safe as long as ServerBackend remains non-
     //       copyable and non-movable as otherwise "this" pointer is not recaptured on copy/move)
 }
 
-int ServerBackend::getContentLength(const char * in_request_header, string& out_server_response_str, bool& out_transaction_in_progress)
+int ServerBackend::getContentLength(const Session& in_session, const char * in_request_header, Response& out_server_response, bool& out_transaction_in_progress)
 {
     assert(!(nullptr == in_request_header));
     
-    if (Constants::wire_protocol.isValidRequestFormat(in_request_header))
+    RequestTuple client_request_tuple;
+    
+    const char * request_fields = in_request_header + (in_session.m_multiplexed ? CorrelationId::s_correlation_id_len : 0);
+    
+    // validates and extracts the header in one pass
+    bool extracted = Constants::binary_protocol_version == in_session.m_protocol_version ? Constants::binary_wire_protocol.extractRequestFields(request_fields, client_request_tuple) : Constants::wire_protocol.extractRequestFields(request_fields, client_request_tuple);
+    
+    if (extracted)
     {
-        auto [command, txn_id, seq_num, content_len, data] = getClientRequestAsTuple(in_request_header);
+        auto& [command, txn_id, seq_num, content_len, data] = client_request_tuple;
         
-        return content_len;
+        // Note: The connection buffer is sized to hold the whole request, so a content length
+        //       the server will not buffer is rejected before anything is allocated for it.
+        if (content_len <= Constants::max_content_len)
+        {
+            return content_len;
+        }
     }
-    else
+    
+    SET_FORMATTING_ERROR();
+    
+    tagResponse(in_session, in_request_header, out_server_response);
+    
+    return -1;
+}
+
+int ServerBackend::getRequestHeaderLength(const Session& in_session)
+{
+    if (Constants::binary_protocol_version == in_session.m_protocol_version)
     {
-        SET_FORMATTING_ERROR();
-        
-        return -1;
+        return static_cast<int>(Constants::binary_wire_protocol.s_request_header_len + (in_session.m_multiplexed ? CorrelationId::s_correlation_id_len : 0));
     }
+    
+    return Constants::request_header_len;
 }
 
-int ServerBackend::getRequestHeaderLength()
+bool ServerBackend::isMultiplexed(const Session& in_session)
 {
-    return Constants::request_header_len;
+    return in_session.m_multiplexed;
+}
+
+int ServerBackend::negotiateSession(const char * in_data, size_t in_len, Session& out_session, Response& out_server_response)
+{
+    assert(!(nullptr == in_data));
+    
+    int requested_version, requested_flags, requested_codec;
+    
+    int preface_len = ProtocolPreface::decode(in_data, in_len, requested_version, requested_flags, requested_codec);
+    
+    if (preface_len > 0)
+    {
+        out_session.m_protocol_version = Constants::binary_protocol_version == requested_version ? Constants::binary_protocol_version : Constants::text_protocol_version;
+        
+        // the text protocol has no room for a correlation id so flags are only accepted in binary
+        out_session.m_multiplexed = Constants::binary_protocol_version == out_session.m_protocol_version && (requested_flags & ProtocolPreface::s_multiplexed_flag);
+        
+        out_session.m_payload_codec = Constants::binary_protocol_version == out_session.m_protocol_version && PayloadCodec::isSupported(requested_codec) ? requested_codec : PayloadCodec::s_none;
+        
+        out_session.m_checksummed = Constants::binary_protocol_version == out_session.m_protocol_version && (requested_flags & ProtocolPreface::s_checksum_flag);
+        
+        out_session.m_nack = Constants::binary_protocol_version == out_session.m_protocol_version && (requested_flags & ProtocolPreface::s_nack_flag);
+        
+        int accepted_flags = (out_session.m_multiplexed ? ProtocolPreface::s_multiplexed_flag : 0) | (out_session.m_checksummed ? ProtocolPreface::s_checksum_flag : 0) | (out_session.m_nack ? ProtocolPreface::s_nack_flag : 0);
+        
+        out_server_response = Response();
+        
+        out_server_response.m_header.resize(ProtocolPreface::s_preface_len);
+        
+        ProtocolPreface::encode(out_server_response.m_header.data(), out_session.m_protocol_version, accepted_flags, out_session.m_payload_codec);
+    }
+    
+    return preface_len;
 }
 
-void ServerBackend::processRequest(const char * in_request_header, const char * in_request_payload, string& out_server_response_str, bool& out_transaction_in_progress)
+void ServerBackend::processRequest(const Session& in_session, const char * in_request_header, const char * in_request_payload, Response& out_server_response, bool& out_transaction_in_progress)
 {
     assert(!(nullptr == in_request_header || nullptr == in_request_payload));
     
     initializeFunctionsAndTransactions();
     
-    processCommand(getClientRequestAsTuple(in_request_header, in_request_payload), out_server_response_str, out_transaction_in_progress);
+    RequestTuple client_request_tuple;
+    
+    auto error = getClientRequestAsTuple(in_session, in_request_header, in_request_payload, client_request_tuple);
+    
+    if (Errors::nil == error)
+    {
+        processCommand(in_session, client_request_tuple, out_server_response, out_transaction_in_progress);
+    }
+    else if (Errors::ChecksumMismatch == error)
+    {
+        // Note: The header was intact so the error names the request, which the client may send
+        //       again as the transaction is left as it was.
+        auto& [command, txn_id, seq_num, content_len, data] = client_request_tuple;
+        
+        SET_RESPONSE_5(Constants::error_cmd, txn_id, seq_num, error, Errors::getErrorMessage(error));
+    }
+    else
+    {
+        SET_FORMATTING_ERROR();
+    }
+    
+    tagResponse(in_session, in_request_header, out_server_response);
 }
 
 // ↑                                                                                            ↑ //
@@ -96,57 +187,129 @@ void ServerBackend::processRequest(const char * in_request_header, const char *
 // Private Member Functions                                                                       //
 // ↓                                                                                            ↓ //
 
-ServerBackend::string ServerBackend::generateResponse(const char * in_command, TxnId in_txn_id, SeqNum in_seq_num, Errors::ErrorMapIterator in_error, const Data& in_data)
+ServerBackend::Response ServerBackend::generateResponse(const Session& in_session, const char * in_command, TxnId in_txn_id, SeqNum in_seq_num, Errors::ErrorMapIterator in_error, Data in_data, std::optional<uint32_t> in_checksum)
 {
     assert(!(nullptr == in_command));
     
-    int err_code = 0;
+    int err_code = Errors::getErrorCode(in_error);
     
-    if (Errors::nil != in_error)
-    {
-        err_code = Errors::getErrorCode(in_error);
-    }
+    // Note: The checksum is of the payload before it is framed and is sent in the header buffer,
+    //       after the header itself, so the data is not copied to prepend it.
+    size_t checksum_len = in_session.m_checksummed && !in_data.empty() ? Crc32c::s_checksum_len : 0;
     
-    string response_header;
+    uint32_t checksum = !checksum_len ? 0 : in_checksum ? *in_checksum : Crc32c::compute(in_data);
     
-    response_header.reserve(Constants::response_header_len);
+    // Note: The payload is framed before the header is encoded as framing may compress it.
+    Response response{ResponseHeader(), PayloadCodec::s_none == in_session.m_payload_codec ? move(in_data) : PayloadCodec::encode(in_session.m_payload_codec, in_data)};
     
-    response_header = string(in_command) + Constants::delimiting_character + to_string(in_txn_id) + Constants::delimiting_character + to_string(in_seq_num) + Constants::delimiting_character + to_string(err_code) + Constants::delimiting_character + to_string(in_data.length());
+    auto& response_header = response.m_header;
     
-    if (response_header.length() < Constants::response_header_len)
+    bool binary = Constants::binary_protocol_version == in_session.m_protocol_version;
+    
+    // room is left in front of the header for the correlation id, which tagResponse fills in
+    size_t correlation_id_len = in_session.m_multiplexed ? CorrelationId::s_correlation_id_len : 0;
+    
+    [[maybe_unused]] bool encoded;
+    
+    if (binary)
+    {
+        response_header.resize(correlation_id_len + Constants::binary_wire_protocol.s_response_header_len + checksum_len);
+        
+        encoded = Constants::binary_wire_protocol.encodeResponse(response_header.data() + correlation_id_len, in_command, in_txn_id, in_seq_num, err_code, checksum_len + response.m_data.length());
+        
+        if (checksum_len)
+        {
+            LittleEndian::store32(response_header.data() + correlation_id_len + Constants::binary_wire_protocol.s_response_header_len, checksum);
+        }
+    }
+    else if (auto p_response_template = getResponseTemplate(in_command, in_error, response.m_data.length()))
     {
-        response_header.push_back(Constants::delimiting_character);
+        response_header.resize(Constants::response_header_len);
+        
+        encoded = renderResponseTemplate(*p_response_template, in_txn_id, in_seq_num, response_header.data());
+    }
+    else
+    {
+        response_header.resize(Constants::response_header_len);
+        
+        encoded = Constants::wire_protocol.encodeResponse(response_header.data(), in_command, in_txn_id, in_seq_num, err_code, response.m_data.length());
     }
-    
-    response_header.append(Constants::response_header_len - response_header.length(), Constants::padding_character);
     
 #ifdef DEBUG
-    if (!Constants::wire_protocol.isValidResponseFormat(response_header.c_str()))
+    string header(response_header.data() + correlation_id_len, response_header.length() - correlation_id_len - checksum_len);
+    
+    if (!(encoded && (binary ? Constants::binary_wire_protocol.isValidResponseFormat(header.c_str()) : Constants::wire_protocol.isValidResponseFormat(header.c_str()))))
     {
-        std::cerr << "Server generated header \"" << response_header << "\" is invalid" << std::endl;
+        std::cerr << "Server generated header \"" << header << "\" is invalid" << std::endl;
     }
 #endif
     
-    return response_header + in_data;
+    return response;
 }
 
-ServerBackend::RequestTuple ServerBackend::getClientRequestAsTuple(const char * in_request_header, const char * in_request_payload)
+Errors::ErrorMapIterator ServerBackend::getClientRequestAsTuple(const Session& in_session, const char * in_request_header, const char * in_request_payload, RequestTuple& out_client_request_tuple)
 {
-    RequestTuple client_request_tuple;
-    
     if (in_request_header)
     {
-        Constants::wire_protocol.extractHeaderFields(in_request_header, client_request_tuple);
+        // already validated by getContentLength
+        if (Constants::binary_protocol_version == in_session.m_protocol_version)
+        {
+            Constants::binary_wire_protocol.extractRequestFields(in_request_header + (in_session.m_multiplexed ? CorrelationId::s_correlation_id_len : 0), out_client_request_tuple);
+        }
+        else
+        {
+            Constants::wire_protocol.extractRequestFields(in_request_header, out_client_request_tuple);
+        }
         
         if (in_request_payload)
         {
-            auto& [command, txn_id, seq_num, content_len, data] = client_request_tuple;
+            auto& [command, txn_id, seq_num, content_len, data] = out_client_request_tuple;
+            
+            // Note: The payload is not null terminated as it is read in place from the receive
+            //       buffer, so at most content_len bytes are taken from it.
+            string_view payload(in_request_payload, content_len);
+            
+            uint32_t checksum = 0;
+            
+            if (in_session.m_checksummed && !payload.empty())
+            {
+                if (payload.length() < Crc32c::s_checksum_len)
+                {
+                    return Errors::InvalidMessageFormat;
+                }
+                
+                checksum = LittleEndian::load32(payload.data());
+                
+                payload.remove_prefix(Crc32c::s_checksum_len);
+            }
             
-            data = string(in_request_payload);
+            Data decoded_payload;
+            
+            if (!(PayloadCodec::s_none == in_session.m_payload_codec))
+            {
+                if (!PayloadCodec::decode(in_session.m_payload_codec, payload, decoded_payload))
+                {
+                    return Errors::InvalidMessageFormat;
+                }
+                
+                payload = decoded_payload;
+            }
+            
+            if (in_session.m_checksummed && !(checksum == Crc32c::compute(payload)))
+            {
+                return Errors::ChecksumMismatch;
+            }
+            
+            // Note: The records of a WRITE_BATCH hold binary lengths and a PUT separates its file
+            //       name from the contents with a null character so their payloads are taken
+            //       whole, any other stops at the first null character.
+            bool whole_payload = Constants::write_batch_cmd == command || Constants::put_cmd == command;
+            
+            data = whole_payload ? string(payload) : string(payload.data(), strnlen(payload.data(), payload.length()));
         }
     }
     
-    return client_request_tuple;
+    return Errors::nil;
 }
 
 auto ServerBackend::getNewFileAttributes(const FileName& in_file_name)
@@ -162,8 +325,13 @@ auto ServerBackend::getNewFileAttributes(const FileName& in_file_name)
         
         return SharedPtrFileAttributes(p_file_attributes, [this](auto p_file_attributes)
                                        {
+                                           lock_guard<mutex> file_attributes_grd(m_file_attributes_mtx);
                                            auto it = m_file_name_to_ptr_to_file_attributes.find(p_file_attributes->m_file_name);
-                                           m_file_name_to_ptr_to_file_attributes.erase(it);
+                                           // the entry may already refer to replacement file attributes (see addNewTransaction)
+                                           if (end(m_file_name_to_ptr_to_file_attributes) != it && p_file_attributes == it->second)
+                                           {
+                                               m_file_name_to_ptr_to_file_attributes.erase(it);
+                                           }
                                            delete p_file_attributes;
                                        });
     }
@@ -173,71 +341,207 @@ auto ServerBackend::getNewFileAttributes(const FileName& in_file_name)
     }
 }
 
-auto ServerBackend::getNewTransactionAttributes(SharedPtrTransactionMutex&& in_sp_txn_mtx, SharedPtrFileAttributes&& in_sp_file_attributes, Timestamp in_timestamp)
+ServerBackend::SharedPtrFileAttributes ServerBackend::getFileAttributes(const FileName& in_file_name)
 {
-    return TransactionAttributesTuple(move(in_sp_txn_mtx), move(in_sp_file_attributes), BufferMap(), Constants::initial_seq_num + 1, in_timestamp);
+    SharedPtrFileAttributes sp_file_attributes;
+    
+    lock_guard<mutex> file_attributes_grd(m_file_attributes_mtx);
+    
+    auto fntptfa_it = m_file_name_to_ptr_to_file_attributes.find(in_file_name);
+    
+    if (!(end(m_file_name_to_ptr_to_file_attributes) == fntptfa_it))
+    {
+        // Note: The last transaction on the file may have just been removed from another shard,
+        //       in which case the file attributes are waiting on m_file_attributes_mtx to be
+        //       deleted and are replaced here instead.
+        if (!(sp_file_attributes = fntptfa_it->second->weak_from_this().lock()))
+        {
+            m_file_name_to_ptr_to_file_attributes.erase(fntptfa_it);
+        }
+    }
+    
+    if (!sp_file_attributes)
+    {
+        sp_file_attributes = getNewFileAttributes(in_file_name);
+    }
+    
+    return sp_file_attributes;
 }
 
-void ServerBackend::addNewTransaction(TxnId in_txn_id, FileName&& in_file_name)
+void ServerBackend::updateFileChecksum(const FileName& in_file_name, FileSize in_file_size, const vector<const Data *>& in_buffers)
 {
-    auto fntptfa_it = m_file_name_to_ptr_to_file_attributes.find(in_file_name);
+    uint32_t appended_checksum = 0;
     
-    auto curr_timestamp = NOW;
+    FileSize appended_len = 0;
     
-    auto sp_txn_mtx = make_shared<mutex>();
+    // hashed before m_file_checksums_mtx is acquired as only the mutex of the file is needed
+    for (auto p_buffer : in_buffers)
+    {
+        appended_checksum = Crc32c::compute(*p_buffer, appended_checksum);
+        
+        appended_len += p_buffer->length();
+    }
+    
+    FileSize prev_file_size = in_file_size - appended_len;
+    
+    lock_guard<mutex> file_checksums_grd(m_file_checksums_mtx);
     
-    if (end(m_file_name_to_ptr_to_file_attributes) == fntptfa_it)
+    auto fntfc_it = m_file_name_to_file_checksum.find(in_file_name);
+    
+    if (0 == prev_file_size)
+    {
+        m_file_name_to_file_checksum[in_file_name] = {in_file_size, appended_checksum};
+    }
+    else if (end(m_file_name_to_file_checksum) == fntfc_it)
     {
-        m_txn_id_to_transaction_attributes.emplace(in_txn_id, getNewTransactionAttributes(move(sp_txn_mtx), getNewFileAttributes(in_file_name), curr_timestamp));
+        return; // the file was not created by a commit since the server started
+    }
+    else if (prev_file_size == fntfc_it->second.m_file_size)
+    {
+        fntfc_it->second = {in_file_size, Crc32c::combine(fntfc_it->second.m_checksum, appended_checksum, appended_len)};
     }
     else
     {
-        const auto& [file_name, p_file_attributes] = *fntptfa_it;
+        m_file_name_to_file_checksum.erase(fntfc_it); // the file was changed by other means
+    }
+}
+
+uint32_t ServerBackend::getFileChecksum(const FileName& in_file_name, const Data& in_contents)
+{
+    {
+        lock_guard<mutex> file_checksums_grd(m_file_checksums_mtx);
         
-        auto sp_file_attributes = p_file_attributes->shared_from_this();
+        auto fntfc_it = m_file_name_to_file_checksum.find(in_file_name);
         
-        m_txn_id_to_transaction_attributes.emplace(in_txn_id, getNewTransactionAttributes(move(sp_txn_mtx), move(sp_file_attributes), curr_timestamp));
+        if (!(end(m_file_name_to_file_checksum) == fntfc_it) && static_cast<FileSize>(in_contents.length()) == fntfc_it->second.m_file_size)
+        {
+            return fntfc_it->second.m_checksum;
+        }
     }
     
-    logTransaction(m_transaction_log, in_txn_id, in_file_name);
+    return Crc32c::compute(in_contents);
+}
+
+ServerBackend::TxnId ServerBackend::getNewTransactionId(unique_lock<mutex>& out_member_lck)
+{
+    // Note: Each thread creates its transactions in its own home shard, so threads creating
+    //       transactions at the same time neither share a counter nor contend on a shard mutex,
+    //       while the threads together still spread transactions across the shards.
+    static thread_local size_t home_shard_index = m_next_home_shard_index++;
+    
+    TxnId new_txn_id;
+    
+    Shard * p_shard;
+    
+    // Note: Ids wrap around once every epoch has been used, while the commit set keeps every id
+    //       committed since the server started, so an id that is still open or committed is
+    //       skipped rather than handed out again.
+    do
+    {
+        if (out_member_lck.owns_lock())
+        {
+            out_member_lck.unlock();
+        }
+        
+        new_txn_id = m_txn_id_allocator.allocate(home_shard_index % m_shards.size());
+        
+        p_shard = &getShard(new_txn_id);
+        
+        out_member_lck = unique_lock<mutex>(p_shard->m_member_mtx);
+    }
+    while (p_shard->m_txn_id_to_transaction_attributes.count(new_txn_id) || p_shard->m_commits.count(new_txn_id));
     
-    START_TRANSACTION_TIMER();
+    return new_txn_id;
+}
+
+auto ServerBackend::getNewTransactionAttributes(SharedPtrTransactionMutex&& in_sp_txn_mtx, SharedPtrFileAttributes&& in_sp_file_attributes, Timestamp in_timestamp)
+{
+    return TransactionAttributesTuple(move(in_sp_txn_mtx), move(in_sp_file_attributes), SequenceBuffer(), Constants::initial_seq_num + 1, in_timestamp);
+}
+
+void ServerBackend::addNewTransaction(Shard& io_shard, TxnId in_txn_id, const FileName& in_file_name)
+{
+    auto curr_timestamp = NOW;
+    
+    auto sp_txn_mtx = make_shared<mutex>();
+    
+    auto sp_file_attributes = getFileAttributes(in_file_name);
+    
+    io_shard.m_txn_id_to_transaction_attributes.emplace(in_txn_id, getNewTransactionAttributes(move(sp_txn_mtx), move(sp_file_attributes), curr_timestamp));
+    
+    armTransactionTimer(in_txn_id, curr_timestamp, in_file_name);
+}
+
+void ServerBackend::armTransactionTimer(TxnId in_txn_id, Timestamp in_latest_timestamp, const FileName& in_file_name)
+{
+    auto delay = std::chrono::duration_cast<TimerWheel::milliseconds>(in_latest_timestamp + std::chrono::seconds(Constants::transaction_timeout_seconds) - NOW);
+    
+    m_timer_wheel.arm(delay, [this, in_txn_id, in_file_name](TimerWheel::TimerId) { m_timeout_pool.submit([this, in_txn_id, in_file_name]() { m_txn_timer_function(in_txn_id, in_file_name); }); });
+}
+
+const ServerBackend::ResponseTemplate * ServerBackend::getResponseTemplate(const char * in_command, Errors::ErrorMapIterator in_error, size_t in_content_len) const
+{
+    const ResponseTemplate * p_response_template = nullptr;
+    
+    if (Errors::nil == in_error)
+    {
+        for (const auto& response_template : m_response_templates)
+        {
+            if (response_template.m_command == in_command)
+            {
+                p_response_template = &response_template;
+                
+                break;
+            }
+        }
+    }
+    else if (auto it = m_error_code_to_response_template.find(Errors::getErrorCode(in_error)); end(m_error_code_to_response_template) != it)
+    {
+        p_response_template = &it->second;
+    }
+    
+    // the template only applies if every field it holds matches
+    if (p_response_template && p_response_template->m_command == in_command && p_response_template->m_content_len == in_content_len)
+    {
+        return p_response_template;
+    }
+    
+    return nullptr;
+}
+
+ServerBackend::Shard& ServerBackend::getShard(TxnId in_txn_id)
+{
+    // Note: Ids recovered from a run with more shards may hold any shard index.
+    return *m_shards[TransactionIdAllocator::getShardIndex(in_txn_id) % m_shards.size()];
 }
 
 void ServerBackend::initializeFunctions()
 {
-    m_txn_timer_function = [this](const TxnId in_txn_id, Timestamp in_latest_timestamp, const FileName in_file_name)
+    m_txn_timer_function = [this](const TxnId in_txn_id, const FileName& in_file_name)
     {
-        while (1)
+        auto& shard = getShard(in_txn_id);
+        
+        unique_lock<mutex> member_lck(shard.m_member_mtx);
+        
+        auto txn_it = shard.m_txn_id_to_transaction_attributes.find(in_txn_id);
+        
+        if (end(shard.m_txn_id_to_transaction_attributes) != txn_it)
         {
-            std::this_thread::sleep_until(in_latest_timestamp + std::chrono::seconds(Constants::transaction_timeout_seconds));
+            auto& [txn_id, txn_tuple] = *txn_it;
             
-            lock_guard<mutex> member_grd(m_member_mtx);
+            auto& [sp_txn_mtx, sp_file_attributes, buffer, max_seq_num, curr_timestamp] = txn_tuple;
             
-            auto txn_it = m_txn_id_to_transaction_attributes.find(in_txn_id);
-            
-            if (end(m_txn_id_to_transaction_attributes) != txn_it)
+            if (NOW + m_timer_wheel.getTick() >= (curr_timestamp + std::chrono::seconds(Constants::transaction_timeout_seconds))) // transaction timeout, to within a tick
             {
-                auto& [txn_id, txn_tuple] = *txn_it;
+                removeTransaction(shard, txn_it);
                 
-                auto& [sp_txn_mtx, sp_file_attributes, buffer, max_seq_num, curr_timestamp] = txn_tuple;
+                member_lck.unlock();
                 
-                if (NOW >= (curr_timestamp + std::chrono::seconds(Constants::transaction_timeout_seconds))) // transaction timeout
-                {
-                    removeTransaction(txn_it);
-                    
-                    logTransaction(m_timeout_log, in_txn_id, in_file_name);
-                    
-                    return;
-                }
-                else
-                {
-                    in_latest_timestamp = curr_timestamp;
-                }
+                logTransaction(m_timeout_log, in_txn_id, in_file_name);
             }
             else
             {
-                return;
+                armTransactionTimer(in_txn_id, curr_timestamp, in_file_name);
             }
         }
     };
@@ -254,7 +558,16 @@ void ServerBackend::initializeFunctions()
         {
             File file(m_directory + file_name, O_RDONLY);
             
-            SET_READ_AND_RETURN(file.read());
+            Data buffer = file.read();
+            
+            if (in_session.m_checksummed)
+            {
+                uint32_t checksum = getFileChecksum(file_name, buffer);
+                
+                SET_CHECKSUMMED_READ_AND_RETURN(move(buffer), checksum);
+            }
+            
+            SET_READ_AND_RETURN(move(buffer));
         }
         catch (Exception::ErrorOpeningFile)
         {
@@ -272,23 +585,32 @@ void ServerBackend::initializeFunctions()
         
         if (0 == seq_num)
         {
-            TxnId candidate_id;
-            
-            lock_guard<mutex> member_grd(m_member_mtx);
+            unique_lock<mutex> member_lck;
             
-            while (m_txn_id_to_transaction_attributes.count(candidate_id = rand() % INT32_MAX));
+            TxnId candidate_id;
             
             try
             {
-                auto& file_name = const_cast<FileName&>(file_name_const);
+                candidate_id = getNewTransactionId(member_lck);
                 
-                addNewTransaction(candidate_id, move(file_name));
+                addNewTransaction(getShard(candidate_id), candidate_id, file_name_const);
+            }
+            catch (Exception::ErrorAllocatingTransactionId)
+            {
+                SET_ERROR_AND_RETURN(Errors::ErrorCreatingTransaction);
             }
             catch (Exception::ErrorAddingFileAttributes)
             {
                 SET_ERROR_AND_RETURN(Errors::ErrorCreatingTransaction);
             }
             
+            // Note: The shard is released before the transaction is logged so other requests on
+            //       the shard do not wait for the log to reach disk, and so NEW_TXNs on the
+            //       same shard can share a group commit.
+            member_lck.unlock();
+            
+            logTransaction(m_transaction_log, candidate_id, file_name_const);
+            
             SET_NEW_TXN_AND_RETURN(candidate_id);
         }
         else
@@ -297,15 +619,22 @@ void ServerBackend::initializeFunctions()
         }
     };
     
+    // Note: On a session that negotiated ProtocolPreface::s_nack_flag, a WRITE that leaves
+    //       sequence numbers below its own missing is ACKed with the ranges of those sequence
+    //       numbers, so the client can resend them before it commits. A WRITE that is merely
+    //       reordered on its way to the server is reported too, so clients should resend with
+    //       WRITE_BATCH, which skips sequence numbers already received.
     CommandFunction WRITE = COMMAND_FUNCTION_PARAMS
     {
-        unique_lock<mutex> member_lck(m_member_mtx);
-        
         auto& [command, txn_id, seq_num, content_len, data] = in_client_request_tuple;
         
+        auto& shard = getShard(txn_id);
+        
+        unique_lock<mutex> member_lck(shard.m_member_mtx);
+        
         RETURN_ERROR_IF_COMMITTED_OR_INVALID_ID();
         
-        auto& txn_tuple = m_txn_id_to_transaction_attributes[txn_id];
+        auto& txn_tuple = shard.m_txn_id_to_transaction_attributes[txn_id];
         
         auto& [sp_txn_mtx, sp_file_attributes, buffers, max_seq_num, curr_timestamp] = txn_tuple;
         
@@ -328,35 +657,131 @@ void ServerBackend::initializeFunctions()
         
         updateTransactionTimestamp(curr_timestamp);
         
-        if (buffers.count(seq_num))
+        if (!SequenceBuffer::isInRange(seq_num))
+        {
+            SET_ERROR_AND_RETURN(Errors::SequenceNumberOutOfRange);
+        }
+        else if (buffers.contains(seq_num))
         {
             SET_ERROR_AND_RETURN(Errors::RepeatedSequenceNumber);
         }
         else
         {
+            buffers.insert(seq_num, move(data));
+            
+            SeqNum prev_max_seq_num = max_seq_num;
+            
             // Note: max_seq_num = max(max_seq_num, seq_num); has no effect for optimized builds
             if (seq_num > max_seq_num)
             {
                 max_seq_num = seq_num;
             }
             
-            buffers[seq_num] = move(data);
+            // Note: Only the sequence numbers skipped since the highest received before this WRITE
+            //       are reported, so each gap is reported once, by the WRITE that opened it.
+            if (in_session.m_nack && seq_num > prev_max_seq_num)
+            {
+                if (auto missing_ranges = buffers.getMissingRanges(prev_max_seq_num, seq_num - 1); !missing_ranges.empty())
+                {
+                    SET_NACK_AND_RETURN(WriteBatch::encodeRanges(missing_ranges));
+                }
+            }
             
             SET_ACK_AND_RETURN();
         }
     };
     
-    CommandFunction COMMIT = COMMAND_FUNCTION_PARAMS
+    // Note: WRITE_BATCH adds every record of its payload to the transaction while acquiring each
+    //       mutex once, however many records there are. A record whose sequence number has already
+    //       been received (for example when a batch is resent after its ACK was lost) is skipped
+    //       rather than ending the transaction, and the ACK lists the ranges of sequence numbers
+    //       that were accepted with SEQ_NUM holding how many there were.
+    CommandFunction WRITE_BATCH = COMMAND_FUNCTION_PARAMS
     {
-        unique_lock<mutex> member_lck(m_member_mtx);
+        auto& [command, txn_id, seq_num, content_len, data] = in_client_request_tuple;
+        
+        // the records are split before any mutex is acquired, SEQ_NUM of the request holding the
+        // number of them
+        // Note: SEQ_NUM comes from the client, so it is checked against the most records the
+        //       payload could hold before anything is allocated from it.
+        if (seq_num < 0 || static_cast<size_t>(seq_num) > data.size() / WriteBatch::s_record_header_len)
+        {
+            SET_ERROR_AND_RETURN(Errors::InvalidMessageFormat);
+        }
+        
+        vector<std::pair<SeqNum, string_view>> records;
+        
+        records.reserve(seq_num);
+        
+        if (!WriteBatch::forEachRecord(data, [&records](SeqNum in_seq_num, string_view in_data) { records.emplace_back(in_seq_num, in_data); }) || !(static_cast<size_t>(seq_num) == records.size()))
+        {
+            SET_ERROR_AND_RETURN(Errors::InvalidMessageFormat);
+        }
+        
+        auto& shard = getShard(txn_id);
+        
+        unique_lock<mutex> member_lck(shard.m_member_mtx);
+        
+        RETURN_ERROR_IF_COMMITTED_OR_INVALID_ID();
+        
+        auto& txn_tuple = shard.m_txn_id_to_transaction_attributes[txn_id];
+        
+        auto& [sp_txn_mtx, sp_file_attributes, buffers, max_seq_num, curr_timestamp] = txn_tuple;
+        
+        // make a copy of the shared_ptr to ensure the mutex remains allocated for subsequent
+        // acquire
+        auto sp_txn_mtx_cpy = sp_txn_mtx;
+        
+        member_lck.unlock();
+        
+        lock_guard<mutex> transaction_grd(*sp_txn_mtx_cpy);
+        
+        member_lck.lock();
         
+        // Note: If true another process/thread operating on this transaction has since
+        //       committed/aborted. Return error since concurrently attempting to write to and
+        //       commit/abort the same transaction is an error on the client-side.
+        RETURN_ERROR_IF_COMMITTED_OR_ABORTED();
+        
+        member_lck.unlock();
+        
+        updateTransactionTimestamp(curr_timestamp);
+        
+        vector<SeqNum> accepted_seq_nums;
+        
+        accepted_seq_nums.reserve(records.size());
+        
+        for (const auto& [record_seq_num, record_data] : records)
+        {
+            if (buffers.insert(record_seq_num, record_data))
+            {
+                if (record_seq_num > max_seq_num)
+                {
+                    max_seq_num = record_seq_num;
+                }
+                
+                accepted_seq_nums.push_back(record_seq_num);
+            }
+        }
+        
+        std::sort(begin(accepted_seq_nums), end(accepted_seq_nums));
+        
+        SET_BATCH_ACK_AND_RETURN(static_cast<SeqNum>(accepted_seq_nums.size()), WriteBatch::encodeRanges(accepted_seq_nums));
+    };
+    
+    CommandFunction COMMIT = COMMAND_FUNCTION_PARAMS
+    {
         const auto& [command, txn_id, seq_num, content_len, data] = in_client_request_tuple;
         
+        auto& shard = getShard(txn_id);
+        
+        unique_lock<mutex> member_lck(shard.m_member_mtx);
+        
         // Note: Return ACK here if committed as the client may be retransmitting the COMMIT due
         //       to lost ACK from initial COMMIT.
         RETURN_ACK_IF_COMMITTED_OR_ERROR_IF_INVALID_ID();
         
-        auto& txn_tuple = m_txn_id_to_transaction_attributes[txn_id];
+        auto& txn_tuple = shard.m_txn_id_to_transaction_attributes[txn_id];
         
         auto& [sp_txn_mtx, sp_file_attributes, buffers, max_seq_num, curr_timestamp] = txn_tuple;
         
@@ -383,6 +808,10 @@ void ServerBackend::initializeFunctions()
         {
             SET_ERROR_AND_RETURN(Errors::CommitWithInvalidSequenceNumber);
         }
+        else if (seq_num > Constants::max_seq_num)
+        {
+            SET_ERROR_AND_RETURN(Errors::SequenceNumberOutOfRange);
+        }
         else
         {
             max_seq_num = seq_num;
@@ -394,12 +823,11 @@ void ServerBackend::initializeFunctions()
         
         auto& file_mtx = sp_file_attributes->m_file_mtx;
         
-        for (SeqNum seq_num = Constants::initial_seq_num + 1; seq_num <= max_seq_num; ++seq_num) // verify all seq nums received
+        // verify all seq nums received, asking for every one missing at once with SEQ_NUM holding
+        // the first
+        if (SeqNum missing_seq_num = buffers.findFirstMissing(max_seq_num); missing_seq_num <= max_seq_num)
         {
-            if (0 == buffers.count(seq_num))
-            {
-                SET_ASK_RESEND_AND_RETURN(seq_num);
-            }
+            SET_ASK_RESEND_AND_RETURN(missing_seq_num, WriteBatch::encodeRanges(buffers.getMissingRanges(missing_seq_num, max_seq_num)));
         }
         
         try
@@ -408,16 +836,16 @@ void ServerBackend::initializeFunctions()
             
             File file(m_directory + file_name, O_CREAT | O_WRONLY | O_APPEND);
             
-            for (SeqNum seq_num = Constants::initial_seq_num + 1; seq_num <= max_seq_num; ++seq_num)
-            {
-                file.write(buffers.at(seq_num));
-            }
+            auto ordered_buffers = buffers.getOrderedBuffers(max_seq_num);
             
-            m_commits.insert(txn_id);
+            // data must be on disk before the commit is logged
+            file.writeAndSync(ordered_buffers);
             
             logTransaction(m_commit_log, txn_id, file_name);
             
             file_size = file.getFileSize();
+            
+            updateFileChecksum(file_name, file_size, ordered_buffers);
         }
         catch (Exception::ErrorOpeningFile)
         {
@@ -435,20 +863,120 @@ void ServerBackend::initializeFunctions()
         // this entry may have since been invalidated
         member_lck.lock();
         
-        removeTransaction(m_txn_id_to_transaction_attributes.find(txn_id));
+        // Note: The commit set belongs to the shard so the transaction is marked committed under
+        //       its mutex, while the transaction mutex is still held.
+        shard.m_commits.insert(txn_id);
+        
+        removeTransaction(shard, shard.m_txn_id_to_transaction_attributes.find(txn_id));
         
         SET_ACK_AND_RETURN();
     };
     
-    CommandFunction ABORT = COMMAND_FUNCTION_PARAMS
+    // Note: PUT fuses NEW_TXN, a single WRITE and COMMIT. The transaction is never added to the
+    //       shard's transaction table, so it has no buffers or timer, but it is logged to
+    //       m_transaction_log before the file is written and to m_commit_log once the data is on
+    //       disk, exactly as a transaction committed through COMMIT is. A crash in between
+    //       therefore truncates the file back to its size before the PUT on reboot.
+    CommandFunction PUT = COMMAND_FUNCTION_PARAMS
     {
-        unique_lock<mutex> member_lck(m_member_mtx);
+        const auto& [command, txn_id_const, seq_num, content_len, data] = in_client_request_tuple;
+        
+        // the id of the transaction is chosen by the server as for NEW_TXN
+        TxnId txn_id = txn_id_const;
+        
+        auto file_name_len = data.find('\0');
+        
+        if (!(0 == seq_num))
+        {
+            SET_ERROR_AND_RETURN(Errors::InvalidSequenceNumber);
+        }
+        else if (string::npos == file_name_len || 0 == file_name_len)
+        {
+            SET_ERROR_AND_RETURN(Errors::InvalidMessageFormat);
+        }
+        
+        const FileName file_name = data.substr(0, file_name_len);
+        
+        const Data contents = data.substr(file_name_len + 1);
+        
+        unique_lock<mutex> member_lck;
+        
+        try
+        {
+            txn_id = getNewTransactionId(member_lck);
+        }
+        catch (Exception::ErrorAllocatingTransactionId)
+        {
+            SET_ERROR_AND_RETURN(Errors::ErrorCreatingTransaction);
+        }
+        
+        auto& shard = getShard(txn_id);
+        
+        // Note: The id is reserved in the commit set while the file is written so it is not handed
+        //       out to another transaction in the meantime.
+        shard.m_commits.insert(txn_id);
+        
+        member_lck.unlock();
+        
+        auto sp_file_attributes = getFileAttributes(file_name);
+        
+        auto& file_size = sp_file_attributes->m_file_size;
+        
+        auto& file_mtx = sp_file_attributes->m_file_mtx;
+        
+        try
+        {
+            lock_guard<mutex> file_grd(file_mtx);
+            
+            File file(m_directory + file_name, O_CREAT | O_WRONLY | O_APPEND);
+            
+            logTransaction(m_transaction_log, txn_id, file_name);
+            
+            // data must be on disk before the commit is logged
+            file.writeAndSync({&contents});
+            
+            logTransaction(m_commit_log, txn_id, file_name);
+            
+            file_size = file.getFileSize();
+            
+            updateFileChecksum(file_name, file_size, {&contents});
+        }
+        catch (Exception::ErrorOpeningFile)
+        {
+            member_lck.lock();
+            
+            shard.m_commits.erase(txn_id);
+            
+            SET_ERROR_AND_RETURN(Errors::ErrorOpeningFile);
+        }
+        catch (Exception::ErrorWritingToFile)
+        {
+            truncate(file_name.c_str(), file_size);
+            
+            // the transaction was logged so it must be ended for it not to be restarted on reboot
+            logTransaction(m_abort_log, txn_id, file_name);
+            
+            member_lck.lock();
+            
+            shard.m_commits.erase(txn_id);
+            
+            SET_ERROR_AND_RETURN(Errors::ErrorWritingFile);
+        }
         
+        SET_NEW_TXN_AND_RETURN(txn_id);
+    };
+    
+    CommandFunction ABORT = COMMAND_FUNCTION_PARAMS
+    {
         const auto& [command, txn_id, seq_num, content_len, data] = in_client_request_tuple;
         
+        auto& shard = getShard(txn_id);
+        
+        unique_lock<mutex> member_lck(shard.m_member_mtx);
+        
         RETURN_ERROR_IF_COMMITTED_OR_INVALID_ID();
         
-        auto& txn_tuple = m_txn_id_to_transaction_attributes[txn_id];
+        auto& txn_tuple = shard.m_txn_id_to_transaction_attributes[txn_id];
         
         auto& [sp_txn_mtx, sp_file_attributes, buffers, max_seq_num, curr_timestamp] = txn_tuple;
         
@@ -478,16 +1006,51 @@ void ServerBackend::initializeFunctions()
         //       COMMITer to modify or access the aborted transaction).
         transaction_lck.unlock();
         
-        const auto& file_name = sp_file_attributes->m_file_name;
+        // copied as the file attributes may be released along with the transaction
+        const FileName file_name = sp_file_attributes->m_file_name;
         
-        logTransaction(m_abort_log, txn_id, file_name);
+        removeTransaction(shard, shard.m_txn_id_to_transaction_attributes.find(txn_id));
+        
+        member_lck.unlock();
         
-        removeTransaction(m_txn_id_to_transaction_attributes.find(txn_id));
+        logTransaction(m_abort_log, txn_id, file_name);
         
         SET_ACK_AND_RETURN();
     };
     
-    m_command_to_function = {{Constants::read_cmd, READ},{Constants::new_txn_cmd, NEW_TXN},{Constants::write_cmd, WRITE},{Constants::commit_cmd, COMMIT},{Constants::abort_cmd, ABORT}};
+    m_command_to_function = {{Constants::read_cmd, READ},{Constants::new_txn_cmd, NEW_TXN},{Constants::write_cmd, WRITE},{Constants::write_batch_cmd, WRITE_BATCH},{Constants::commit_cmd, COMMIT},{Constants::put_cmd, PUT},{Constants::abort_cmd, ABORT}};
+}
+
+void ServerBackend::initializeResponseTemplates()
+{
+    auto render_template = [](const char * in_command, int in_error_code, size_t in_content_len)
+    {
+        ResponseTemplate response_template;
+        
+        response_template.m_command = in_command;
+        
+        response_template.m_prefix = in_command + string(1, Constants::delimiting_character);
+        
+        response_template.m_suffix = Constants::delimiting_character + to_string(in_error_code) + Constants::delimiting_character + to_string(in_content_len);
+        
+        response_template.m_fields_len = response_template.m_suffix.length();
+        
+        response_template.m_suffix += Constants::delimiting_character + string(Constants::response_header_len, Constants::padding_character);
+        
+        response_template.m_content_len = in_content_len;
+        
+        return response_template;
+    };
+    
+    for (auto command : {Constants::ack_cmd, Constants::ask_resend_cmd})
+    {
+        m_response_templates.push_back(render_template(command, 0, 0));
+    }
+    
+    for (const auto& [error_code, error_message] : Errors::messages)
+    {
+        m_error_code_to_response_template.emplace(error_code, render_template(Constants::error_cmd, error_code, error_message.length()));
+    }
 }
 
 void ServerBackend::initializeTransactions()
@@ -509,9 +1072,17 @@ void ServerBackend::initializeTransactions()
     // the writes to the file.
     truncateFiles(file_names_to_file_sizes);
     
-    for (auto& [txn_id, file_name] : txn_ids_to_file_names) // restart transactions
+    for (const auto& [txn_id, file_name] : txn_ids_to_file_names) // restart transactions
     {
-        addNewTransaction(txn_id, move(file_name));
+        auto& shard = getShard(txn_id);
+        
+        {
+            lock_guard<mutex> member_grd(shard.m_member_mtx);
+            
+            addNewTransaction(shard, txn_id, file_name);
+        }
+        
+        logTransaction(m_transaction_log, txn_id, file_name);
     }
 }
 
@@ -519,7 +1090,7 @@ void ServerBackend::initializeFunctionsAndTransactions()
 {
     if (m_initialize)
     {
-        lock_guard<mutex> member_grd(m_member_mtx);
+        lock_guard<mutex> initialize_grd(m_initialize_mtx);
         
         if (m_initialize)
         {
@@ -598,49 +1169,24 @@ void ServerBackend::loadFilesAndTransactions(FileNameFileSizeMap& out_file_names
 
 void ServerBackend::logTransaction(const FileName& in_log_name, const TxnId in_txn_id, const FileName& in_file_name)
 {
-    try
-    {
-        File log(m_directory + in_log_name, O_CREAT | O_WRONLY | O_APPEND);
-        
-        log.write(to_string(in_txn_id));
-        
-        log.write(" ");
-        
-        log.write(in_file_name);
-        
-        log.write(" ");
-        
-        log.write(to_string(File::getFileSize(in_file_name)));
-        
-        log.write("\n");
-    }
-    catch (Exception::ErrorOpeningFile)
-    {
-#ifdef DEBUG
-        if (std::unique_lock<std::mutex> global_lck(g_mtx); global_lck.owns_lock())
-        {
-            perror("Error opening log file");
-        }
-#endif
-    }
-    catch(Exception::ErrorWritingToFile)
+    // Note: The entry is built up front so it is appended with one write rather than five.
+    string entry = to_string(in_txn_id) + " " + in_file_name + " " + to_string(File::getFileSize(in_file_name)) + "\n";
+    
+    if (!m_group_commit.append(m_directory + in_log_name, entry))
     {
 #ifdef DEBUG
-        if (std::unique_lock<std::mutex> global_lck(g_mtx); global_lck.owns_lock())
-        {
-            perror("Error writing to log file");
-        }
+        perror("Error writing to log file");
 #endif
     }
 }
 
-void ServerBackend::processCommand(const RequestTuple& in_client_request_tuple, string& out_server_response_str, bool& out_transaction_in_progress)
+void ServerBackend::processCommand(const Session& in_session, const RequestTuple& in_client_request_tuple, Response& out_server_response, bool& out_transaction_in_progress)
 {
     const auto& [command, txn_id, seq_num, content_len, data] = in_client_request_tuple;
     
     if (m_command_to_function.count(command))
     {
-        m_command_to_function[command](in_client_request_tuple, out_server_response_str, out_transaction_in_progress);
+        m_command_to_function[command](in_session, in_client_request_tuple, out_server_response, out_transaction_in_progress);
     }
     else // command not found
     {
@@ -648,11 +1194,57 @@ void ServerBackend::processCommand(const RequestTuple& in_client_request_tuple,
     }
 }
 
-void ServerBackend::removeTransaction(TransactionAttributesMapIterator in_txn_it)
+void ServerBackend::removeTransaction(Shard& io_shard, TransactionAttributesMapIterator in_txn_it)
+{
+    if (end(io_shard.m_txn_id_to_transaction_attributes) != in_txn_it)
+    {
+        io_shard.m_txn_id_to_transaction_attributes.erase(in_txn_it);
+    }
+}
+
+bool ServerBackend::renderResponseTemplate(const ResponseTemplate& in_template, TxnId in_txn_id, SeqNum in_seq_num, char * out_header)
+{
+    assert(!(nullptr == out_header));
+    
+    char * p = out_header;
+    
+    char * end = out_header + Constants::response_header_len;
+    
+    memcpy(p, in_template.m_prefix.data(), in_template.m_prefix.length());
+    
+    p += in_template.m_prefix.length();
+    
+    auto [txn_id_end, txn_id_ec] = std::to_chars(p, end, in_txn_id);
+    
+    if (!(std::errc() == txn_id_ec && txn_id_end < end))
+    {
+        return false;
+    }
+    
+    p = txn_id_end;
+    
+    *p++ = Constants::delimiting_character;
+    
+    auto [seq_num_end, seq_num_ec] = std::to_chars(p, end, in_seq_num);
+    
+    if (!(std::errc() == seq_num_ec && in_template.m_fields_len <= static_cast<size_t>(end - seq_num_end)))
+    {
+        return false;
+    }
+    
+    p = seq_num_end;
+    
+    memcpy(p, in_template.m_suffix.data(), end - p);
+    
+    return true;
+}
+
+void ServerBackend::tagResponse(const Session& in_session, const char * in_request_header, Response& io_server_response)
 {
-    if (end(m_txn_id_to_transaction_attributes) != in_txn_it)
+    if (in_session.m_multiplexed && io_server_response.m_header.length() >= CorrelationId::s_correlation_id_len)
     {
-        m_txn_id_to_transaction_attributes.erase(in_txn_it);
+        // the id is opaque to the server so its bytes are copied as they are
+        memcpy(io_server_response.m_header.data(), in_request_header, CorrelationId::s_correlation_id_len);
     }
 }
 
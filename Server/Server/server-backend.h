@@ -15,6 +15,11 @@
 // in order of sequence number (provided the server has received a write request for each         //
 // sequence number up to the maximum sequence number received). Read requests on the other hand,  //
 // do not require a transaction and can be fulfilled with a single request and a single response. //
+//                                                                                                //
+// Note: Transaction state is partitioned into shards, each with its own mutex, transaction table //
+//       and commit set, so requests for independent transactions rarely contend. A transaction   //
+//       id encodes its shard in its lowest bits (see TransactionIdAllocator) so WRITE, COMMIT    //
+//       and ABORT go straight to the owning shard without consulting any shared state.           //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // TODO: periodically purge logs to ensure they remain under some threshold size
@@ -31,23 +36,82 @@
 #ifndef server_backend_h
 #define server_backend_h
 
+#include <atomic>
+#include <cassert>
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include "constants.h"
+#include "crc32c.h"
 #include "errors.h"
 #include "file.h"
+#include "group-commit.h"
+#include "payload-codec.h"
+#include "sequence-buffer.h"
+#include "thread-pool.h"
+#include "timer-wheel.h"
+#include "transaction-id-allocator.h"
 
 namespace EmersonClientServerFileSystem
 {
     class ServerBackend
     {
         
+    public:
+        
+        // Note: A ResponseHeader is formatted in place in a fixed buffer large enough for a header
+        //       of any protocol version, so generating a response never allocates for its header.
+        class ResponseHeader
+        {
+            
+        private:
+            
+            char m_buffer[Constants::response_header_len];
+            
+            size_t m_len = 0;
+            
+        public:
+            
+            char * data() { return m_buffer; }
+            
+            const char * data() const { return m_buffer; }
+            
+            size_t length() const { return m_len; }
+            
+            void resize(size_t in_len) { assert(in_len <= sizeof(m_buffer)); m_len = in_len; }
+        };
+        
+        // Note: The header and data of a response are kept apart so data such as the contents of
+        //       a file being read is never copied just to prepend the header.
+        struct Response
+        {
+            ResponseHeader m_header;
+            std::string m_data;
+        };
+        
+        // Note: A Session holds the state negotiated on one connection, the version of the wire
+        //       protocol its headers are encoded in, whether they carry correlation ids, the
+        //       PayloadCodec its payloads are framed with, whether they carry checksums and
+        //       whether gaps in a transaction's sequence numbers are reported as WRITEs arrive.
+        struct Session
+        {
+            int m_protocol_version = Constants::text_protocol_version;
+            bool m_multiplexed = false;
+            int m_payload_codec = PayloadCodec::s_none;
+            bool m_checksummed = false;
+            bool m_nack = false;
+        };
+        
     private:
         
         ////////////////////////////////////////////////////////////////////////////////////////////
@@ -56,6 +120,8 @@ namespace EmersonClientServerFileSystem
         
         using atomic_bool = std::atomic_bool;
         
+        using atomic_size_t = std::atomic_size_t;
+        
         using high_resolution_clock = std::chrono::high_resolution_clock;
         
         using ifstream = std::ifstream;
@@ -64,6 +130,8 @@ namespace EmersonClientServerFileSystem
         
         using string = std::string;
         
+        using string_view = std::string_view;
+        
         using stringstream = std::stringstream;
         
         using thread = std::thread;
@@ -95,15 +163,19 @@ namespace EmersonClientServerFileSystem
         template<class T>
         using unordered_set = std::unordered_set<T>;
         
+        template<class T>
+        using vector = std::vector<T>;
+        
         template<class T>
         static constexpr auto make_shared = [](auto&&... ts) constexpr -> decltype(auto) { return std::make_shared<T>(std::forward<decltype(ts)>(ts)...);};
         
         template<class T>
         static constexpr auto make_unique = [](auto&&... ts) constexpr -> decltype(auto) { return std::make_unique<T>(std::forward<decltype(ts)>(ts)...);};
         
-        static constexpr auto max = [](auto v1, auto v2) constexpr -> decltype(auto) { return std::max(v1, v2);};
+        // Note: returns by value as std::max returns a reference to one of the by-value parameters
+        static constexpr auto max = [](auto v1, auto v2) constexpr { return std::max(v1, v2);};
         
-        static constexpr auto move = [](auto t) constexpr -> decltype(auto) { return std::move(t);};
+        static constexpr auto move = [](auto&& t) constexpr -> decltype(auto) { return std::move(t);};
         
         static constexpr auto to_string = [](auto t) constexpr -> decltype(auto) { return std::to_string(t);};
         
@@ -137,9 +209,9 @@ namespace EmersonClientServerFileSystem
         //       to send back to the client as well as whether or not the transaction is still in
         //       progress. For example, if the client sent an abort or commit request,
         //       OutTxnInProgress will be set to false assuming the request was successful.
-        using CommandFunction = function<void(const RequestTuple& in_message, string& out_response, bool& out_transaction_in_progress)>;
+        using CommandFunction = function<void(const Session& in_session, const RequestTuple& in_message, Response& out_response, bool& out_transaction_in_progress)>;
         
-        using TimerFunction = function<void(const TxnId in_txn_id, Timestamp in_prev_timestamp, const FileName in_file_name)>;
+        using TimerFunction = function<void(const TxnId in_txn_id, const FileName& in_file_name)>;
         
         using CommandMap = unordered_map<Command, CommandFunction>;
         
@@ -149,8 +221,6 @@ namespace EmersonClientServerFileSystem
         
         using TxnIdFileNameMap = unordered_map<TxnId, FileName>;
         
-        using BufferMap = unordered_map<SeqNum, Data>;
-        
         using SharedPtrTransactionMutex = shared_ptr<mutex>;
         
         using SharedPtrFileAttributes = shared_ptr<FileAttributes>;
@@ -163,7 +233,7 @@ namespace EmersonClientServerFileSystem
         //       allocated even in the event another client has just committed/aborted the same
         //       transaction. Although such an occurrence is an error on the client-side, this
         //       ensures the server will not crash attempting to acquire a deallocated mutex.
-        using TransactionAttributesTuple = tuple/*<., ., ., MaxSeqNumReceived, TimeOfMostRecentTxnUpdate>*/<SharedPtrTransactionMutex, SharedPtrFileAttributes, BufferMap, SeqNum, Timestamp>;
+        using TransactionAttributesTuple = tuple/*<., ., ., MaxSeqNumReceived, TimeOfMostRecentTxnUpdate>*/<SharedPtrTransactionMutex, SharedPtrFileAttributes, SequenceBuffer, SeqNum, Timestamp>;
         
         using TransactionAttributesMap = unordered_map<TxnId, TransactionAttributesTuple>;
         
@@ -171,6 +241,40 @@ namespace EmersonClientServerFileSystem
         
         using CommitSet = unordered_set<TxnId>;
         
+        // Note: Every field of a text response header but TXN_ID and SEQ_NUM is known ahead of time
+        //       for responses without data (such as the ACK to a WRITE) and for ERROR responses, so
+        //       those fields are rendered once. Padding is included for the longest TXN_ID and
+        //       SEQ_NUM so the rest of a header is always a prefix of m_suffix.
+        struct ResponseTemplate
+        {
+            Command m_command;
+            string m_prefix; // COMMAND and a delimiter
+            string m_suffix; // a delimiter, ERROR_CODE, a delimiter, CONTENT_LEN, then a delimiter and padding
+            size_t m_fields_len; // length of m_suffix before its padding
+            size_t m_content_len;
+        };
+        
+        using ErrorCodeResponseTemplateMap = unordered_map<int, ResponseTemplate>;
+        
+        // Note: A file checksum is only valid while the file is m_file_size bytes long, so a READ
+        //       of a file of any other size checksums the data it read instead.
+        struct FileChecksum
+        {
+            FileSize m_file_size;
+            uint32_t m_checksum;
+        };
+        
+        using FileChecksumMap = unordered_map<FileName, FileChecksum>;
+        
+        // Note: Shards are aligned to separate cache lines so threads working in different shards
+        //       do not contend on the same line when acquiring their mutexes.
+        struct alignas(64) Shard
+        {
+            mutex m_member_mtx;
+            TransactionAttributesMap m_txn_id_to_transaction_attributes;
+            CommitSet m_commits; // keeps track of committed transaction ids
+        };
+        
         // ↑                                                                                    ↑ //
         // Type Aliases                                                                           //
         ////////////////////////////////////////////////////////////////////////////////////////////
@@ -179,24 +283,51 @@ namespace EmersonClientServerFileSystem
         // Member Variables                                                                       //
         // ↓                                                                                    ↓ //
         
-        //Note: The m_txn_timer_function runs on a separate thread for each transaction and sits
-        //      in a tight loop sleeping until the lastest transaction timestamp +
-        //      Constants::transaction_timeout_seconds. It then wakes up to retreive the most
-        //      recent transaction timestamp again (in case it has since changed) and checks to
-        //      see if it is within Constants::transaction_timeout_seconds of the current time.
-        //      If it is, the transaction has not timed out, and so the latest transaction
-        //      timestamp is updated and the loop repeated. Otherwise, the transaction is
-        //      terminated and the function returns. The function will also return if the
-        //      transaction has terminated by some other means.
+        //Note: The m_txn_timer_function runs on m_timeout_pool once a transaction's timer, armed
+        //      for its latest timestamp + Constants::transaction_timeout_seconds, expires, since it
+        //      locks a shard and logs the timeout which m_timer_wheel's thread must not wait on.
+        //      It retrieves the most recent transaction timestamp again (in case it has since
+        //      changed) and checks to see if it is within Constants::transaction_timeout_seconds
+        //      of the current time. If it is, the transaction has not timed out, and so the timer
+        //      is armed again for the latest timestamp. Otherwise, the transaction is terminated.
+        //      Requests therefore only update the timestamp and never touch the timer. The
+        //      function does nothing if the transaction has terminated by some other means.
         TimerFunction m_txn_timer_function;
         
+        // shared with the ServerDispatcher's connection timeouts
+        TimerWheel& m_timer_wheel;
+        
         CommandMap m_command_to_function;
         
-        TransactionAttributesMap m_txn_id_to_transaction_attributes;
+        // unique_ptr as Shard contains a mutex which is not copyable/movable
+        vector<unique_ptr<Shard>> m_shards;
+        
+        // assigns each thread the shard it allocates new transaction ids from, round robin
+        atomic_size_t m_next_home_shard_index = ATOMIC_VAR_INIT(0);
         
+        // Note: File attributes are shared by every transaction on the same file regardless of
+        //       shard, so they are kept apart behind their own mutex. They are only looked up when
+        //       a transaction is created or removed.
         FileAttributesMap m_file_name_to_ptr_to_file_attributes;
         
-        CommitSet m_commits; // keeps track of committed transaction ids
+        mutex m_file_attributes_mtx;
+        
+        // Note: The checksum of a file is recorded when it is created by a commit and extended by
+        //       every later commit, so a READ on a checksummed connection does not hash the whole
+        //       file. Entries outlive the file attributes as files do, so they are kept apart.
+        //
+        // Note: The checksums are only kept in memory and cover the current run of the server. A
+        //       file written before it started is checksummed from the data a READ just read, so
+        //       its payload is protected on the wire but damage on disk goes unnoticed.
+        FileChecksumMap m_file_name_to_file_checksum;
+        
+        mutex m_file_checksums_mtx;
+        
+        // Note: Response templates are only written by the constructor so they are read without
+        //       locking.
+        vector<ResponseTemplate> m_response_templates; // only a few, so they are searched in order
+        
+        ErrorCodeResponseTemplateMap m_error_code_to_response_template;
         
         const FileName m_transaction_log = ".transactionlog.txt";
         
@@ -206,12 +337,23 @@ namespace EmersonClientServerFileSystem
         
         const FileName m_abort_log = ".abortlog.txt";
         
+        const FileName m_epoch_file = ".txnepoch.txt";
+        
         const string m_directory;
         
-        mutex m_member_mtx;
+        TransactionIdAllocator m_txn_id_allocator; // must follow m_epoch_file and m_directory
+        
+        // makes the log records of concurrent requests durable together
+        GroupCommit m_group_commit;
+        
+        mutex m_initialize_mtx;
         
         atomic_bool m_initialize = ATOMIC_VAR_INIT(true);
         
+        // runs expired transaction timers off m_timer_wheel's thread, last so it is joined before
+        // the members its tasks use are destroyed
+        ThreadPool m_timeout_pool;
+        
         // ↑                                                                                    ↑ //
         // Member Variables                                                                       //
         ////////////////////////////////////////////////////////////////////////////////////////////
@@ -220,28 +362,73 @@ namespace EmersonClientServerFileSystem
         // Member Functions                                                                       //
         // ↓                                                                                    ↓ //
         
-        // returns a string generated from the input arguments and formatted according to the
-        // response protocol to be used as the server's response to the client
-        string generateResponse(const char * in_command, TxnId in_txn_id, SeqNum in_seq_num, Errors::ErrorMapIterator in_error = Errors::nil, const Data& in_data = "");
+        // returns a response generated from the input arguments and formatted according to the
+        // response protocol of in_session to be used as the server's response to the client
+        //
+        // Note: in_checksum is the Crc32c checksum of in_data if it is already known, it is
+        //       otherwise computed if in_session is checksummed.
+        Response generateResponse(const Session& in_session, const char * in_command, TxnId in_txn_id, SeqNum in_seq_num, Errors::ErrorMapIterator in_error = Errors::nil, Data in_data = "", std::optional<uint32_t> in_checksum = std::nullopt);
+        
+        // returns Errors::InvalidMessageFormat if the payload is not framed as PayloadCodec
+        // requires for in_session or Errors::ChecksumMismatch if it does not match its checksum,
+        // otherwise returns Errors::nil and sets out_client_request_tuple to the client request by
+        // using the wire protocol of in_session to extract the relevant fields
+        Errors::ErrorMapIterator getClientRequestAsTuple(const Session& in_session, const char * in_request_header, const char * in_request_payload, RequestTuple& out_client_request_tuple);
+        
+        // Note: The mutex of the file attributes of in_file_name must be acquired before
+        //       invocation of updateFileChecksum.
+        //
+        // extends the checksum of in_file_name, now in_file_size bytes long, with in_buffers just
+        // appended to it, or records it if the file was created by them
+        void updateFileChecksum(const FileName& in_file_name, FileSize in_file_size, const vector<const Data *>& in_buffers);
+        
+        // returns the checksum of in_contents, just read from in_file_name, without hashing them if
+        // the checksum of the file at their length was recorded by updateFileChecksum
+        uint32_t getFileChecksum(const FileName& in_file_name, const Data& in_contents);
         
-        // returns the client request as a tuple by using the wire protocol to extract the
-        // relevant fields
-        RequestTuple getClientRequestAsTuple(const char * in_request_header, const char * in_request_payload = nullptr);
+        // returns shared pointer to the file attributes of in_file_name, creating them if no
+        // transaction in progress refers to them
+        SharedPtrFileAttributes getFileAttributes(const FileName& in_file_name);
         
+        // Note: m_file_attributes_mtx must be acquired before invocation of getNewFileAttributes.
+        //
         // creates and returns shared pointer to new file attributes and associates file name
         // with raw pointer to these file attributes
         auto getNewFileAttributes(const FileName& in_file_name);
         
+        // returns the transaction id for a new transaction, with out_member_lck holding the mutex
+        // of the shard it belongs to so the transaction can be added to it, throwing
+        // Exception::ErrorAllocatingTransactionId if no id can be allocated
+        TxnId getNewTransactionId(unique_lock<mutex>& out_member_lck);
+        
         // creates and returns a TransactionAttributesTuple
         auto getNewTransactionAttributes(SharedPtrTransactionMutex&& in_sp_txn_mtx, SharedPtrFileAttributes&& in_sp_file_attributes, Timestamp timestamp);
         
-        // adds a new entry to the transaction attributes map, creating new file attributes if
-        // necessary
-        void addNewTransaction(TxnId in_txn_id, FileName&& in_file_name);
+        // arms a timer running m_txn_timer_function once in_latest_timestamp is
+        // Constants::transaction_timeout_seconds old
+        void armTransactionTimer(TxnId in_txn_id, Timestamp in_latest_timestamp, const FileName& in_file_name);
+        
+        // Note: The mutex of io_shard must be acquired before invocation of addNewTransaction.
+        //       The transaction is not logged here, so the caller can release the mutex before
+        //       it logs the transaction to m_transaction_log.
+        //
+        // adds a new entry to the transaction attributes map of io_shard, creating new file
+        // attributes if necessary
+        void addNewTransaction(Shard& io_shard, TxnId in_txn_id, const FileName& in_file_name);
+        
+        // returns the template for a response with the given command, error, and content length,
+        // or nullptr if there is none
+        const ResponseTemplate * getResponseTemplate(const char * in_command, Errors::ErrorMapIterator in_error, size_t in_content_len) const;
+        
+        // returns the shard that owns the transaction with id in_txn_id
+        Shard& getShard(TxnId in_txn_id);
         
         // used for initializing the timer function and command functions
         void initializeFunctions();
         
+        // renders a template for ACK and ASK_RESEND responses without data and for each error
+        void initializeResponseTemplates();
+        
         // Note: initializeTransactions retrieves the last known consistent state of the file
         //       system from loadFilesAndTransactions. initializeTransactions then uses this
         //       state to restart any transactions that were in progress at the time of the last
@@ -267,7 +454,9 @@ namespace EmersonClientServerFileSystem
         void loadFilesAndTransactions(FileNameFileSizeMap& out_file_names_to_file_sizes, TxnIdFileNameMap& out_txn_ids_to_file_names);
         
         // Note: logTransaction is only called when a transaction is created, timed out,
-        //       committed, or aborted.
+        //       committed, or aborted. It returns once the entry is on disk, which it shares
+        //       with the entries logged by every other request at about the same time (see
+        //       GroupCommit).
         //
         // appends a new line to the hidden log file containing the transaction id, file name,
         // and file size each delimited by a space character
@@ -275,14 +464,22 @@ namespace EmersonClientServerFileSystem
         
         // extracts and validates command from in_message and defers to the associated command
         // function
-        void processCommand(const RequestTuple& in_message, string& out_response, bool& out_transaction_in_progress);
+        void processCommand(const Session& in_session, const RequestTuple& in_message, Response& out_response, bool& out_transaction_in_progress);
         
-        // Note: removeTransaction is not thread-safe so mutex protecting shared data structure
-        //       m_txn_ids_to_transaction_attributes must be acquired before invocation of
+        // Note: removeTransaction is not thread-safe so the mutex of io_shard protecting its
+        //       m_txn_id_to_transaction_attributes must be acquired before invocation of
         //       removeTransaction in a multithreaded environment.
         //
-        // removes given iterator from the transaction attributes map
-        void removeTransaction(TransactionAttributesMapIterator in_txn_it);
+        // removes given iterator from the transaction attributes map of io_shard
+        void removeTransaction(Shard& io_shard, TransactionAttributesMapIterator in_txn_it);
+        
+        // writes exactly Constants::response_header_len characters to out_header and returns false
+        // if in_txn_id and in_seq_num leave no room for the rest of in_template
+        static bool renderResponseTemplate(const ResponseTemplate& in_template, TxnId in_txn_id, SeqNum in_seq_num, char * out_header);
+        
+        // copies the correlation id of in_request_header in front of the header of
+        // io_server_response if in_session is multiplexed
+        static void tagResponse(const Session& in_session, const char * in_request_header, Response& io_server_response);
         
         // Note: truncateFiles is necessary on reboot in case the server crashed or lost power
         //       during one or more commit operations that had yet to complete. This ensures the
@@ -299,18 +496,35 @@ namespace EmersonClientServerFileSystem
     public:
         
         // ctor in_directory argument corresponds to directory where files and logs are to be
-        // stored
-        ServerBackend(string in_directory);
+        // stored, transaction timeouts are run by io_timer_wheel, in_num_shards of 0 creates one
+        // shard per core
+        ServerBackend(string in_directory, TimerWheel& io_timer_wheel, int in_num_shards = 0);
         
         // returns the content length found in the request header, otherwise returns error and
         // sets the server response
-        int getContentLength(const char * in_request_header, string& out_server_response_str, bool& out_transaction_in_progress);
+        int getContentLength(const Session& in_session, const char * in_request_header, Response& out_server_response, bool& out_transaction_in_progress);
+        
+        // returns the request header length according to the protocol of in_session
+        int getRequestHeaderLength(const Session& in_session);
         
-        // returns the request header length according to the protocol
-        int getRequestHeaderLength();
+        // Note: negotiateSession is given the first bytes received on a connection. A client that
+        //       does not start with a ProtocolPreface keeps the text protocol and none of its
+        //       bytes are consumed. An unsupported version is answered with the text protocol
+        //       version, which the client must then use.
+        //
+        // returns the number of bytes of in_data consumed, setting out_session and the reply to
+        // the preface in out_server_response, or -1 if more bytes are needed to tell
+        int negotiateSession(const char * in_data, size_t in_len, Session& out_session, Response& out_server_response);
+        
+        // Note: The requests of a multiplexed session may be processed concurrently and out of
+        //       order. Each ends only its own transaction, so out_transaction_in_progress is
+        //       meaningless for them and the connection stays open unless a header is malformed.
+        //
+        // returns true if in_session was negotiated with ProtocolPreface::s_multiplexed_flag
+        bool isMultiplexed(const Session& in_session);
         
         // forwards request to processCommand for processing of request
-        void processRequest(const char * in_request_header, const char * in_request_payload, string& out_server_response_str, bool& out_transaction_in_progress);
+        void processRequest(const Session& in_session, const char * in_request_header, const char * in_request_payload, Response& out_server_response, bool& out_transaction_in_progress);
         
         // ↑                                                                                    ↑ //
         // Member Functions                                                                       //
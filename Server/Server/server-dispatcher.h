@@ -11,44 +11,112 @@
 // request is extracted and passed to the backend server for processing. Afer processing, the     //
 // backend server sets a response for the ServerDispatcher to send back to the client.            //
 //                                                                                                //
-// Note: ServerDispatcher is multithreaded, spawning a thread to handle each incoming connection. //
+// Note: ServerDispatcher is multithreaded. It runs a number of event loops, each on its own      //
+//       thread with its own listening socket bound to the same port with SO_REUSEPORT, so the    //
+//       kernel spreads new connections across the loops. Each loop waits on an edge-triggered    //
+//       EventNotifier, accepts connections from its listening socket, and is the only thread     //
+//       that closes the connections it accepted, so no global lock is required on the accept or  //
+//       readiness paths. Requests are processed by a ThreadPool, one work item per request, and  //
+//       a connection with no request waiting to be read does not occupy a thread.                //
+//                                                                                                //
+// Note: Linux balances connections across SO_REUSEPORT listeners. macOS permits the binding but  //
+//       does not balance, so most connections may arrive on a single loop there.                 //
+//                                                                                                //
+// Note: If a Unix domain socket path is given, the first event loop also accepts connections on  //
+//       an AF_UNIX stream socket bound to that path. Clients on the same host can use it to      //
+//       avoid loopback TCP overhead. The wire protocol is the same on both transports and so is  //
+//       all connection handling past accept.                                                     //
+//                                                                                                //
+// Note: Each connection has a receive buffer. A work item reads everything available on the      //
+//       socket into it and then processes every complete request it holds, so pipelined requests //
+//       are handled in batches rather than with separate reads for each header and payload. A    //
+//       partially received request stays in the buffer until more data arrives.                  //
+//                                                                                                //
+// Note: Sockets are non-blocking and no thread ever waits for a peer to receive. Responses are   //
+//       queued on their connection and sent (many per sendmsg) as far as the socket allows. The  //
+//       rest is sent when the socket becomes writable again. While more than                     //
+//       s_outbound_high_water_mark bytes are queued, no further requests are read from the       //
+//       connection.                                                                              //
+//                                                                                                //
+// Note: The requests of a multiplexed connection are each submitted to the ThreadPool as soon as //
+//       they are received, so a slow request does not hold up those behind it. Responses are     //
+//       queued as requests complete, in any order, and the client matches them up by the         //
+//       correlation id the backend copies into each. At most s_max_requests_in_flight are in     //
+//       flight per connection. Requests that depend on each other, such as a COMMIT and the      //
+//       WRITEs before it, must not be sent until the earlier ones are acknowledged.              //
 //                                                                                                //
 // Note: ServerDispatcher will terminate a connection if m_connection_timeout_seconds elapse      //
-//       without receiving a packet.                                                              //
+//       without receiving a packet. Each connection has a timer in the TimerWheel shared with    //
+//       the backend, armed for when the connection would be idle for that long. When it expires  //
+//       the connection is handed to its EventLoop, which retires it if it was idle throughout    //
+//       and otherwise arms the timer again for its latest activity, so receiving a packet never  //
+//       touches the timer.                                                                       //
 //                                                                                                //
 // Note: ServerDispatcher is templatized on ServerBackend to support greater flexibility and      //
 //       reusability. All that is required is for ServerBackend to implement:                     //
 //                                                                                                //
-//       int getContentLength(const char * in_request_header, string& out_server_response_str,    //
-//                            bool& out_transaction_in_progress);                                 //
+//       struct Response { Header m_header; string m_data; }; // Header has data() and length()   //
+//                                                                                                //
+//       struct Session; // default constructible, one per connection                             //
+//                                                                                                //
+//       int negotiateSession(const char * in_data, size_t in_len, Session& out_session,          //
+//                            Response& out_server_response);                                     //
 //                                                                                                //
-//       int getRequestHeaderLength();                                                            //
+//       int getContentLength(const Session& in_session, const char * in_request_header,          //
+//                            Response& out_server_response, bool& out_transaction_in_progress);  //
 //                                                                                                //
-//       void processRequest(const char * in_request_header, const char * in_request_payload,     //
-//                           string& out_server_response_str, bool& out_transaction_in_progress); //
+//       int getRequestHeaderLength(const Session& in_session);                                   //
+//                                                                                                //
+//       bool isMultiplexed(const Session& in_session);                                           //
+//                                                                                                //
+//       void processRequest(const Session& in_session, const char * in_request_header,           //
+//                           const char * in_request_payload, Response& out_server_response,      //
+//                           bool& out_transaction_in_progress);                                  //
+//                                                                                                //
+//       negotiateSession is called with the first bytes received on a connection and returns how //
+//       many of them it consumed, or -1 if it needs more. Every later call for the connection is //
+//       passed the Session it negotiated.                                                        //
+//                                                                                                //
+//       in_request_payload points into the receive buffer and is not null terminated, it holds   //
+//       exactly the number of bytes returned by getContentLength for the same header. For a      //
+//       multiplexed Session processRequest is instead given a copy of the request and may be     //
+//       called concurrently, and out_transaction_in_progress is ignored.                         //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// TODO: use a thread pool
-
-// TODO: handle case where m_max_sockfd exceeds FD_SETSIZE
-
 #ifndef server_dispatcher_h
 #define server_dispatcher_h
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <functional>
 #ifdef DEBUG
 #include <iostream>
 #endif
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-#include "read-write-helper.h"
-
-extern std::mutex g_mtx;
+#include "event-notifier.h"
+#include "thread-pool.h"
+#include "timer-wheel.h"
 
 namespace EmersonClientServerFileSystem
 {
@@ -58,14 +126,26 @@ namespace EmersonClientServerFileSystem
         
     private:
         
-        using condition_variable = std::condition_variable;
-        
         using mutex = std::mutex;
         
+        using steady_clock = std::chrono::steady_clock;
+        
         using string = std::string;
         
+        using Response = typename ServerBackend::Response;
+        
+        using Session = typename ServerBackend::Session;
+        
+        using TimerId = TimerWheel::TimerId;
+        
         using thread = std::thread;
         
+        template<class T>
+        using atomic = std::atomic<T>;
+        
+        template<class T>
+        using deque = std::deque<T>;
+        
         template<class T>
         using function = std::function<T>;
         
@@ -78,324 +158,1011 @@ namespace EmersonClientServerFileSystem
         template<class T>
         using unique_ptr = std::unique_ptr<T>;
         
+        template<class T>
+        using unordered_set = std::unordered_set<T>;
+        
         template<class T>
         using vector = std::vector<T>;
         
-        int m_backlog;
+        struct Connection;
         
-        int m_listenfd;
+        // Note: Receive buffers grow to fit a request with a larger payload and shrink back to this
+        //       size once it has been processed.
+        static constexpr size_t s_receive_buffer_len = 4 * 1'024;
         
-        int m_portno;
+        // Note: m_connections is only accessed by the thread running the EventLoop
+        //
+        // Note: m_idle_connections holds the connections whose idle timers expired along with the
+        //       id of the timer, as the connection may have been closed by the time the EventLoop
+        //       checks it. It is protected by m_idle_mtx.
+        struct EventLoop
+        {
+            int m_listenfd = -1;
+            int m_unix_listenfd = -1; // only the first event loop listens on the Unix domain socket
+            EventNotifier m_notifier;
+            unordered_set<Connection *> m_connections;
+            atomic<Connection *> m_p_retired_connections = ATOMIC_VAR_INIT(nullptr); // lock-free stack of connections waiting to be closed
+            mutex m_idle_mtx;
+            vector<std::pair<Connection *, TimerId>> m_idle_connections;
+        };
+        
+        // Note: A Connection is registered with the notifier of the EventLoop that accepted it as
+        //       the context of its socket so the loop can signal readiness without looking the
+        //       socket up. Connections are only ever deleted by their EventLoop's thread (see
+        //       reclaimConnections) so a readiness event can never refer to a deleted Connection.
+        //
+        // Note: m_scheduled is true while a work item for the Connection is queued or running in
+        //       m_thread_pool. When it is false the Connection is parked and only the EventLoop's
+        //       thread may schedule it again (on readiness) or retire it (on idle timeout).
+        //
+        // Note: The receive buffer and outbound queue are only accessed by the work item that owns
+        //       the Connection. Bytes in [m_receive_begin, m_receive_end) have been received but
+        //       not processed, while m_outbound_offset bytes of the front response have been sent.
+        //
+        // Note: The requests of a multiplexed session run as work items of their own. They hand
+        //       their responses over in m_completed_responses and the Connection is never retired
+        //       while m_requests_in_flight is non-zero. Both are protected by m_mtx.
+        struct Connection
+        {
+            Connection(int in_sockfd, EventLoop& in_event_loop) : m_sockfd(in_sockfd), m_event_loop(in_event_loop), m_last_activity(steady_clock::now()) {}
+            const int m_sockfd;
+            EventLoop& m_event_loop;
+            bool m_ready = false; // set by the EventLoop's thread, cleared when parking
+            bool m_scheduled = true;
+            steady_clock::time_point m_last_activity;
+            mutex m_mtx;
+            vector<char> m_receive_buffer = vector<char>(s_receive_buffer_len);
+            size_t m_receive_begin = 0;
+            size_t m_receive_end = 0;
+            Session m_session;
+            bool m_session_negotiated = false; // set once the first bytes received have been checked for a preface
+            deque<Response> m_outbound_responses;
+            vector<Response> m_completed_responses; // sent by the next work item that owns the connection
+            size_t m_requests_in_flight = 0;
+            size_t m_outbound_offset = 0;
+            size_t m_outbound_bytes = 0; // bytes queued but not yet sent
+            bool m_closing = false; // set once the last response has been queued
+            Connection * m_p_next_retired = nullptr;
+            TimerId m_idle_timer_id = TimerWheel::s_no_timer; // only accessed by the EventLoop's thread
+        };
+        
+        enum class IoStatus { Complete, WouldBlock, Failed };
+        
+        static constexpr int s_max_events = 1'024;
+        
+#ifdef MSG_NOSIGNAL
+        static constexpr int s_send_flags = MSG_NOSIGNAL;
+#else
+        static constexpr int s_send_flags = 0;
+#endif
+        
+#ifdef MSG_MORE
+        static constexpr int s_send_more_flag = MSG_MORE;
+#else
+        static constexpr int s_send_more_flag = 0;
+#endif
+        
+        // responses queued while processing a batch of requests are sent early once they reach
+        // either limit, which also bounds the number of iovecs passed to each sendmsg
+        static constexpr size_t s_max_batched_responses = 64;
+        
+        static constexpr size_t s_max_batched_bytes = 256 * 1'024;
+        
+        static constexpr size_t s_outbound_high_water_mark = 1'024 * 1'024;
+        
+        // no further requests are read from a multiplexed connection while this many are in flight
+        static constexpr size_t s_max_requests_in_flight = 64;
         
-        int m_sockfd;
+        int m_backlog;
+        
+        int m_portno;
         
-        int m_max_sockfd;
+        int m_max_connections;
         
         const time_t m_connection_timeout_seconds;
         
         const string m_ipv4_addr;
         
-        socklen_t m_cli_len;
+        const string m_unix_path;
+        
+        // number of open connections across all event loops
+        atomic<int> m_num_connections = ATOMIC_VAR_INIT(0);
         
-        struct sockaddr_in m_cli_addr;
-
         // unique_ptr to handle case where ServerBackend is not copyable/movable
         unique_ptr<ServerBackend> m_up_backend;
         
-        function<void(int)> m_processRequest;
+        TimerWheel& m_timer_wheel;
+        
+        // reads what is available on the connection, processes every complete request received
+        // and then either reschedules, parks, or retires the connection
+        function<void(Connection *)> m_processRequest;
+        
+        ThreadPool m_thread_pool;
         
-        function<void()> m_notifier;
+        // unique_ptr as EventLoop contains atomics which are not copyable/movable
+        vector<unique_ptr<EventLoop>> m_event_loops;
         
-        vector<condition_variable> m_fd_cvs;
+        void acceptConnections(EventLoop& in_event_loop, int in_listenfd);
         
-        vector<mutex> m_fd_mtxs;
+        // Note: Only called on the EventLoop's thread.
+        //
+        // arms the idle timer of in_p_connection to hand it to its EventLoop after in_delay
+        void armIdleTimer(Connection * in_p_connection, std::chrono::milliseconds in_delay);
         
-        fd_set m_rfds;
+        // moves the responses of completed requests onto the outbound queue and returns the
+        // number of requests still in flight
+        size_t collectCompletedResponses(Connection& in_connection);
         
-        void initializeConditionVariablesAndMutexes();
+        // called by the work item of a multiplexed request once in_server_response is ready
+        void completeRequest(Connection * in_p_connection, Response&& in_server_response);
         
-        void initializeNotifier();
+        void initializeFileDescriptorLimit();
         
         void initializeProcessRequest();
         
-        void initializeSocket();
+        void initializeSockets(int in_num_event_loops);
+        
+        void initializeUnixSocket();
+        
+        // Note: If in_more is true the kernel is told more responses follow (MSG_MORE on Linux)
+        //       so it may hold back a partial segment.
+        //
+        // sends queued responses until the queue is empty (IoStatus::Complete) or the socket
+        // would block (IoStatus::WouldBlock)
+        IoStatus flushResponses(Connection& in_connection, bool in_more = false);
+        
+        // returns false if the connection should be closed once its queued responses are sent
+        bool processReceivedRequests(Connection& in_connection);
+        
+        // Note: readSocket fills the receive buffer until the socket would block (returning
+        //       IoStatus::WouldBlock) or the buffer is full (returning IoStatus::Complete).
+        IoStatus readSocket(Connection& in_connection);
+        
+        // returns true if the connection was parked, false if the socket became ready in the
+        // meantime in which case the caller still owns the connection
+        bool parkConnection(Connection * in_p_connection);
+        
+        void reclaimConnections(EventLoop& in_event_loop);
+        
+        void retireConnection(Connection * in_p_connection);
         
-        bool readSocket(int in_sockfd, char * out_buffer, int in_buffer_len);
+        // retires the connections whose idle timers expired if they were idle throughout
+        void retireIdleConnections(EventLoop& in_event_loop);
+        
+        void runEventLoop(EventLoop& in_event_loop);
+        
+        // called on the EventLoop's thread whenever in_p_connection becomes readable or writable
+        void scheduleConnection(Connection * in_p_connection);
+        
+        // submits the processing of a multiplexed request, copying it out of the receive buffer,
+        // and returns the number of requests in flight on the connection including it
+        size_t submitRequest(Connection& in_connection, const char * in_request, size_t in_request_header_len, size_t in_content_len);
         
     public:
         
-        ServerDispatcher(const string& in_ipv4_addr, int in_portno, int in_backlog, int in_max_sockfd, time_t in_connection_timeout_seconds, unique_ptr<ServerBackend>&& in_up_backend);
+        // Note: in_num_event_loops of 0 runs one event loop per core and an empty in_unix_path
+        //       disables the Unix domain socket listener. Connection timeouts are run by
+        //       io_timer_wheel.
+        ServerDispatcher(const string& in_ipv4_addr, int in_portno, const string& in_unix_path, int in_backlog, int in_max_connections, int in_num_event_loops, int in_num_worker_threads, time_t in_connection_timeout_seconds, unique_ptr<ServerBackend>&& in_up_backend, TimerWheel& io_timer_wheel);
         
         void start();
         
     };
     
     template<class ServerBackend>
-    ServerDispatcher<ServerBackend>::ServerDispatcher(const string& in_ipv4_addr, int in_portno, int in_backlog, int in_max_sockfd, time_t in_connection_timeout_seconds, unique_ptr<ServerBackend>&& in_up_backend) : m_ipv4_addr(in_ipv4_addr), m_portno(in_portno), m_backlog(in_backlog), m_max_sockfd(in_max_sockfd), m_connection_timeout_seconds(in_connection_timeout_seconds), m_up_backend(move(in_up_backend))
+    ServerDispatcher<ServerBackend>::ServerDispatcher(const string& in_ipv4_addr, int in_portno, const string& in_unix_path, int in_backlog, int in_max_connections, int in_num_event_loops, int in_num_worker_threads, time_t in_connection_timeout_seconds, unique_ptr<ServerBackend>&& in_up_backend, TimerWheel& io_timer_wheel) : m_backlog(in_backlog), m_portno(in_portno), m_max_connections(in_max_connections), m_connection_timeout_seconds(in_connection_timeout_seconds), m_ipv4_addr(in_ipv4_addr), m_unix_path(in_unix_path), m_up_backend(move(in_up_backend)), m_timer_wheel(io_timer_wheel), m_thread_pool(in_num_worker_threads)
     {
-        FD_ZERO(&m_rfds);
-        
-        initializeConditionVariablesAndMutexes();
-        
-        initializeNotifier();
+        initializeFileDescriptorLimit();
         
         initializeProcessRequest();
         
-        initializeSocket();
+        initializeSockets(in_num_event_loops > 0 ? in_num_event_loops : std::max(1, static_cast<int>(thread::hardware_concurrency())));
+        
+        if (!m_unix_path.empty())
+        {
+            initializeUnixSocket();
+        }
     }
     
     template<class ServerBackend>
     void ServerDispatcher<ServerBackend>::start()
     {
-        thread(m_notifier).detach();
+        vector<thread> event_loop_threads;
         
-        while (1)
+        for (size_t i = 1; i < m_event_loops.size(); ++i)
         {
-            unique_lock<mutex> fd_lck(m_fd_mtxs[m_listenfd]);
-            
-            m_fd_cvs[m_listenfd].wait(fd_lck);
-            
-            unique_lock<mutex> global_lck(g_mtx);
+            event_loop_threads.emplace_back(&ServerDispatcher::runEventLoop, this, std::ref(*m_event_loops[i]));
+        }
+        
+        runEventLoop(*m_event_loops.front()); // the calling thread runs the first event loop
+        
+        for (auto& event_loop_thread : event_loop_threads)
+        {
+            event_loop_thread.join();
+        }
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::acceptConnections(EventLoop& in_event_loop, int in_listenfd)
+    {
+        while (1) // edge-triggered so accept until the backlog is drained
+        {
+#ifdef __linux__
+            int sockfd = accept4(in_listenfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+            int sockfd = accept(in_listenfd, nullptr, nullptr);
             
-            m_sockfd = accept(m_listenfd, (struct sockaddr *) &m_cli_addr, &m_cli_len);
+            if (!(sockfd < 0))
+            {
+                fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+                
+                fcntl(sockfd, F_SETFD, FD_CLOEXEC);
+            }
+#endif
             
-            if (m_sockfd < 0)
+            if (sockfd < 0)
             {
-                perror("Error on accept");
+                if (EINTR == errno || ECONNABORTED == errno)
+                {
+                    continue;
+                }
                 
-                exit(EXIT_FAILURE);
+                if (!(EAGAIN == errno || EWOULDBLOCK == errno))
+                {
+                    perror("Error on accept");
+                }
+                
+                return;
             }
             
-            if (m_sockfd > m_max_sockfd)
+            if (m_num_connections.fetch_add(1) >= m_max_connections)
             {
+                m_num_connections.fetch_sub(1);
+                
 #ifdef DEBUG
                 std::cerr << "Maximum connections reached... closing connection" << std::endl;
 #endif
-                close(m_sockfd);
+                close(sockfd);
                 
                 continue;
             }
             
-            FD_SET(m_sockfd, &m_rfds);
+#ifdef DEBUG
+            std::cout << "opened socket descriptor " + std::to_string(sockfd) + "\n" << std::flush; // one insertion so concurrent lines do not interleave
+#endif
             
-            global_lck.unlock();
+            auto p_connection = new Connection(sockfd, in_event_loop);
             
-#ifdef DEBUG
-            global_lck.lock();
+            in_event_loop.m_connections.insert(p_connection);
             
-            std::cout << "opened socket descriptor " << m_sockfd << std::endl;
+            armIdleTimer(p_connection, std::chrono::seconds(m_connection_timeout_seconds));
             
-            global_lck.unlock();
-#endif
+            in_event_loop.m_notifier.add(sockfd, p_connection, true);
             
-            thread(m_processRequest, m_sockfd).detach();
+            // the client may have sent a request before the socket was registered so the
+            // connection starts out scheduled rather than waiting for readiness
+            m_thread_pool.submit([this, p_connection]() { m_processRequest(p_connection); });
         }
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::armIdleTimer(Connection * in_p_connection, std::chrono::milliseconds in_delay)
+    {
+        assert(!(nullptr == in_p_connection));
         
-        close(m_listenfd);
+        auto& event_loop = in_p_connection->m_event_loop;
         
-        FD_CLR(m_listenfd, &m_rfds);
+        // Note: The timer only hands the connection over as the EventLoop is the one thread that
+        //       knows whether it is still open.
+        in_p_connection->m_idle_timer_id = m_timer_wheel.arm(in_delay, [&event_loop, in_p_connection](TimerId in_timer_id)
+                                                             {
+                                                                 if (unique_lock<mutex> idle_lck(event_loop.m_idle_mtx); idle_lck.owns_lock())
+                                                                 {
+                                                                     event_loop.m_idle_connections.emplace_back(in_p_connection, in_timer_id);
+                                                                 }
+                                                                 event_loop.m_notifier.wakeup();
+                                                             });
     }
     
     template<class ServerBackend>
-    void ServerDispatcher<ServerBackend>::initializeConditionVariablesAndMutexes()
+    size_t ServerDispatcher<ServerBackend>::collectCompletedResponses(Connection& in_connection)
     {
-        decltype(m_fd_cvs) tmp_fd_cvs(m_max_sockfd + 1);
+        lock_guard<mutex> connection_grd(in_connection.m_mtx);
         
-        swap(m_fd_cvs, tmp_fd_cvs);
+        for (auto& server_response : in_connection.m_completed_responses)
+        {
+            in_connection.m_outbound_bytes += server_response.m_header.length() + server_response.m_data.length();
+            
+            in_connection.m_outbound_responses.push_back(std::move(server_response));
+        }
         
-        decltype(m_fd_mtxs) tmp_fd_mtxs(m_max_sockfd + 1);
+        in_connection.m_completed_responses.clear();
         
-        swap(m_fd_mtxs, tmp_fd_mtxs);
+        return in_connection.m_requests_in_flight;
     }
     
     template<class ServerBackend>
-    void ServerDispatcher<ServerBackend>::initializeNotifier()
+    void ServerDispatcher<ServerBackend>::completeRequest(Connection * in_p_connection, Response&& in_server_response)
     {
-        m_notifier = [this]()
+        assert(!(nullptr == in_p_connection));
+        
+        unique_lock<mutex> connection_lck(in_p_connection->m_mtx);
+        
+        in_p_connection->m_completed_responses.push_back(std::move(in_server_response));
+        
+        --in_p_connection->m_requests_in_flight;
+        
+        // Note: The connection is scheduled under the same lock as the request is counted out, as
+        //       once it is released a parked connection with no requests in flight may be retired.
+        if (in_p_connection->m_scheduled) // the work item that owns the connection will send it
+        {
+            in_p_connection->m_ready = true;
+        }
+        else
         {
-            fd_set rfds;
+            in_p_connection->m_scheduled = true;
             
-            struct timeval tv;
+            in_p_connection->m_ready = false;
             
-            int nfds = m_max_sockfd + 1;
+            connection_lck.unlock();
             
-            while (1)
+            m_thread_pool.submit([this, in_p_connection]() { m_processRequest(in_p_connection); });
+        }
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::initializeFileDescriptorLimit()
+    {
+        // raise the soft limit on open file descriptors to the hard limit so the number of
+        // connections is bounded by m_max_connections rather than the default soft limit
+        struct rlimit limit;
+        
+        if (0 == getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::initializeProcessRequest()
+    {
+        m_processRequest = [this](Connection * in_p_connection)
+        {
+            auto& connection = *in_p_connection;
+            
+            size_t requests_in_flight = collectCompletedResponses(connection);
+            
+            auto write_status = flushResponses(connection); // send what earlier work items could not
+            
+            auto read_status = IoStatus::WouldBlock;
+            
+            if (!(IoStatus::Failed == write_status || connection.m_closing) && connection.m_outbound_bytes < s_outbound_high_water_mark && requests_in_flight < s_max_requests_in_flight)
             {
-                tv.tv_sec = 0;
+                read_status = readSocket(connection);
                 
-                tv.tv_usec = 100'000;
+                // Note: Requests received before a failed read are still processed as the client
+                //       may have closed its end of the connection right after sending them.
+                if (!processReceivedRequests(connection) || IoStatus::Failed == read_status)
+                {
+                    connection.m_closing = true;
+                }
                 
-                unique_lock<mutex> global_lck(g_mtx);
+                write_status = flushResponses(connection);
+            }
+            
+            if (IoStatus::Failed == write_status)
+            {
+                connection.m_closing = true; // nothing more can be sent so nothing more is read
+            }
+            
+            // Note: A connection with requests in flight is parked rather than retired. Completing a
+            //       request flags the connection ready, so a response collected here or completed
+            //       later is sent by the work item submitted when parking fails or by the next one
+            //       scheduled.
+            if (connection.m_closing && 0 == collectCompletedResponses(connection) && (IoStatus::Failed == write_status || connection.m_outbound_responses.empty()))
+            {
+                retireConnection(in_p_connection);
+            }
+            else if (IoStatus::Complete == read_status && !connection.m_closing && connection.m_outbound_bytes < s_outbound_high_water_mark) // buffer filled before the socket drained
+            {
+                m_thread_pool.submit([this, in_p_connection]() { m_processRequest(in_p_connection); });
+            }
+            else if (!parkConnection(in_p_connection)) // socket became ready while parking
+            {
+                m_thread_pool.submit([this, in_p_connection]() { m_processRequest(in_p_connection); });
+            }
+        };
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::initializeSockets(int in_num_event_loops)
+    {
+        struct sockaddr_in serv_addr;
+        
+        bzero((char *) &serv_addr, sizeof(serv_addr));
+        
+        serv_addr.sin_family = AF_INET;
+        
+        serv_addr.sin_addr.s_addr = inet_addr(m_ipv4_addr.c_str());
+        
+        serv_addr.sin_port = htons(m_portno);
+        
+        for (int i = 0; i < in_num_event_loops; ++i)
+        {
+            auto up_event_loop = std::make_unique<EventLoop>();
+            
+            int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+            
+            if (listenfd < 0)
+            {
+                perror("Error opening socket");
                 
-                rfds = m_rfds;
+                exit(EXIT_FAILURE);
+            }
+            
+            // accepts are driven by edge-triggered notifications so the listening socket must
+            // never block once its backlog has been drained
+            fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+            
+            fcntl(listenfd, F_SETFD, FD_CLOEXEC);
+            
+            int reuse_port = 1;
+            
+            if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse_port, sizeof(reuse_port)) < 0)
+            {
+                perror("Error setting SO_REUSEPORT");
                 
-                int numReadyFileDescriptors = select(nfds, &rfds, nullptr, nullptr, &tv);
+                exit(EXIT_FAILURE);
+            }
+            
+            if (bind(listenfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0)
+            {
+                perror("Error on binding");
                 
-                if (numReadyFileDescriptors < 0)
+                exit(EXIT_FAILURE);
+            }
+            
+            listen(listenfd, m_backlog);
+            
+            up_event_loop->m_listenfd = listenfd;
+            
+            m_event_loops.push_back(move(up_event_loop));
+        }
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::initializeUnixSocket()
+    {
+        struct sockaddr_un serv_addr;
+        
+        bzero((char *) &serv_addr, sizeof(serv_addr));
+        
+        serv_addr.sun_family = AF_UNIX;
+        
+        // a truncated path would be bound while the cleanup and shutdown unlink the full one
+        if (!(m_unix_path.length() < sizeof(serv_addr.sun_path)))
+        {
+            fprintf(stderr, "Error unix path \"%s\" is too long. Please provide a path shorter than %zu characters.\n", m_unix_path.c_str(), sizeof(serv_addr.sun_path));
+            
+            exit(EXIT_FAILURE);
+        }
+        
+        memcpy(serv_addr.sun_path, m_unix_path.c_str(), m_unix_path.length() + 1);
+        
+        int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        
+        if (listenfd < 0)
+        {
+            perror("Error opening unix socket");
+            
+            exit(EXIT_FAILURE);
+        }
+        
+        fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+        
+        fcntl(listenfd, F_SETFD, FD_CLOEXEC);
+        
+        int bind_result = bind(listenfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
+        
+        struct stat path_stat;
+        
+        // a socket left behind by a previous run fails the bind, replace it but never unlink
+        // anything other than a socket
+        if (bind_result < 0 && EADDRINUSE == errno && 0 == lstat(m_unix_path.c_str(), &path_stat) && S_ISSOCK(path_stat.st_mode))
+        {
+            unlink(m_unix_path.c_str());
+            
+            bind_result = bind(listenfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
+        }
+        
+        if (bind_result < 0)
+        {
+            perror("Error on binding unix socket");
+            
+            exit(EXIT_FAILURE);
+        }
+        
+        listen(listenfd, m_backlog);
+        
+        // SO_REUSEPORT does not balance AF_UNIX sockets so a single loop accepts them, after which
+        // their requests are spread across m_thread_pool like any other connection
+        m_event_loops.front()->m_unix_listenfd = listenfd;
+    }
+    
+    template<class ServerBackend>
+    typename ServerDispatcher<ServerBackend>::IoStatus ServerDispatcher<ServerBackend>::flushResponses(Connection& in_connection, bool in_more)
+    {
+        auto& responses = in_connection.m_outbound_responses;
+        
+        struct iovec iovs[2 * s_max_batched_responses];
+        
+        while (!responses.empty())
+        {
+            int num_iovs = 0;
+            
+            size_t offset = in_connection.m_outbound_offset;
+            
+            for (auto it = begin(responses); end(responses) != it && num_iovs + 2 <= static_cast<int>(2 * s_max_batched_responses); ++it)
+            {
+                // the header and data are sent as separate iovecs so neither is copied
+                struct iovec parts[] = {{const_cast<char *>(it->m_header.data()), it->m_header.length()}, {const_cast<char *>(it->m_data.data()), it->m_data.length()}};
+                
+                for (const auto& part : parts)
+                {
+                    if (offset < part.iov_len)
+                    {
+                        iovs[num_iovs++] = {static_cast<char *>(part.iov_base) + offset, part.iov_len - offset};
+                    }
+                    
+                    offset -= std::min(offset, part.iov_len);
+                }
+            }
+            
+            struct msghdr msg;
+            
+            bzero(&msg, sizeof(msg));
+            
+            msg.msg_iov = iovs;
+            
+            msg.msg_iovlen = num_iovs;
+            
+            ssize_t bytes_written = sendmsg(in_connection.m_sockfd, &msg, s_send_flags | (in_more ? s_send_more_flag : 0));
+            
+            if (bytes_written < 0)
+            {
+                if (EAGAIN == errno || EWOULDBLOCK == errno)
+                {
+                    return IoStatus::WouldBlock;
+                }
+                else if (!(EINTR == errno))
                 {
 #ifdef DEBUG
-                    perror("Error on select");
+                    perror("Error writing to socket file descriptor");
 #endif
+                    
+                    return IoStatus::Failed;
                 }
                 
-                global_lck.unlock();
+                continue;
+            }
+            
+            in_connection.m_outbound_bytes -= bytes_written;
+            
+            // pop the responses sent in full and record how much of the next one was sent
+            size_t bytes_remaining = in_connection.m_outbound_offset + bytes_written;
+            
+            while (!responses.empty() && bytes_remaining >= responses.front().m_header.length() + responses.front().m_data.length())
+            {
+                bytes_remaining -= responses.front().m_header.length() + responses.front().m_data.length();
                 
-                for (int fd = m_listenfd; numReadyFileDescriptors > 0 && fd <= m_max_sockfd; ++fd)
-                {
-                    if (FD_ISSET(fd, &rfds))
-                    {
-                        m_fd_cvs[fd].notify_one();
-                        
-                        --numReadyFileDescriptors;
-                    }
-                }
+                responses.pop_front();
             }
-        };
+            
+            in_connection.m_outbound_offset = bytes_remaining;
+        }
+        
+        return IoStatus::Complete;
     }
     
     template<class ServerBackend>
-    void ServerDispatcher<ServerBackend>::initializeProcessRequest()
+    bool ServerDispatcher<ServerBackend>::processReceivedRequests(Connection& in_connection)
     {
-        m_processRequest = [this](int in_sockfd)
+        auto& buffer = in_connection.m_receive_buffer;
+        
+        auto& begin = in_connection.m_receive_begin;
+        
+        auto& end = in_connection.m_receive_end;
+        
+        auto& responses = in_connection.m_outbound_responses;
+        
+        auto& session = in_connection.m_session;
+        
+        if (!in_connection.m_session_negotiated && end > begin)
         {
-#ifdef DEBUG
-            if (unique_lock<mutex> global_lck(g_mtx); global_lck.owns_lock())
+            Response server_response;
+            
+            int preface_len = m_up_backend->negotiateSession(buffer.data() + begin, end - begin, session, server_response);
+            
+            if (preface_len < 0) // wait for the rest of the preface
+            {
+                return true;
+            }
+            
+            begin += preface_len;
+            
+            in_connection.m_session_negotiated = true;
+            
+            if (server_response.m_header.length() > 0)
             {
-                std::cout << "processing socket descriptor " << in_sockfd << std::endl;
+                in_connection.m_outbound_bytes += server_response.m_header.length() + server_response.m_data.length();
+                
+                responses.push_back(std::move(server_response));
             }
+        }
+        
+        size_t request_header_len = m_up_backend->getRequestHeaderLength(session);
+        
+        char request_header[request_header_len + 1]; // add 1 for null terminator
+        
+        request_header[request_header_len] = '\0';
+        
+        size_t num_batched_responses = 0;
+        
+        size_t batched_bytes = 0;
+        
+        bool connection_open = true;
+        
+        bool multiplexed = m_up_backend->isMultiplexed(session);
+        
+        size_t requests_in_flight = 0;
+        
+        while (connection_open && end - begin >= request_header_len && in_connection.m_outbound_bytes < s_outbound_high_water_mark && requests_in_flight < s_max_requests_in_flight)
+        {
+            memcpy(request_header, buffer.data() + begin, request_header_len);
+            
+#ifdef DEBUG
+            std::cout << "processing socket descriptor " + std::to_string(in_connection.m_sockfd) + "\n" << std::flush;
 #endif
             
             bool transaction_in_progress = true;
             
-            do
+            Response server_response;
+            
+            int content_len = m_up_backend->getContentLength(session, request_header, server_response, transaction_in_progress);
+            
+            if (content_len < 0)
             {
-                int request_header_len = m_up_backend->getRequestHeaderLength();
+                begin += request_header_len;
+            }
+            else if (end - begin - request_header_len < static_cast<size_t>(content_len)) // wait for rest of payload
+            {
+                if (buffer.size() < request_header_len + content_len)
+                {
+                    buffer.resize(request_header_len + content_len);
+                }
+                
+                break;
+            }
+            else if (multiplexed) // the response is queued by the request's own work item
+            {
+                requests_in_flight = submitRequest(in_connection, buffer.data() + begin, request_header_len, content_len);
+                
+                begin += request_header_len + content_len;
+                
+                continue;
+            }
+            else
+            {
+                m_up_backend->processRequest(session, request_header, buffer.data() + begin + request_header_len, server_response, transaction_in_progress);
+                
+                begin += request_header_len + content_len;
+            }
+            
+            connection_open = transaction_in_progress;
+            
+            if (server_response.m_header.length() > 0)
+            {
+                size_t response_len = server_response.m_header.length() + server_response.m_data.length();
                 
-                char request_header[request_header_len + 1]; // add 1 for null terminator
+                in_connection.m_outbound_bytes += response_len;
                 
-                bzero(request_header, request_header_len + 1);
+                batched_bytes += response_len;
                 
-                if (readSocket(in_sockfd, request_header, request_header_len))
+                responses.push_back(std::move(server_response));
+                
+                if (++num_batched_responses >= s_max_batched_responses || batched_bytes >= s_max_batched_bytes)
                 {
-                    string server_response;
-                    
-                    int content_len = m_up_backend->getContentLength(request_header, server_response, transaction_in_progress);
-                    
-                    if (content_len < 0)
-                    {
-                        if (server_response.length() > 0 && ReadWriteHelper::writeFileDescriptor(in_sockfd, server_response.c_str(), server_response.length()) < 0)
-                        {
-#ifdef DEBUG
-                            perror("Error writing to socket file descriptor");
-#endif
-                        }
-                    }
-                    else
+                    if (IoStatus::Failed == flushResponses(in_connection, connection_open))
                     {
-                        char request_payload[content_len + 1]; // add 1 for null terminator
-                        
-                        bzero(request_payload, content_len + 1);
-                        
-                        if (readSocket(in_sockfd, request_payload, content_len))
-                        {
-                            m_up_backend->processRequest(request_header, request_payload, server_response, transaction_in_progress);
-                            
-                            if (server_response.length() > 0 && ReadWriteHelper::writeFileDescriptor(in_sockfd, server_response.c_str(), server_response.length()) < 0)
-                            {
-#ifdef DEBUG
-                                perror("Error writing to socket file descriptor");
-#endif
-                            }
-                        }
-                        else // read failed
-                        {
-                            break;
-                        }
+                        return false;
                     }
+                    
+                    num_batched_responses = batched_bytes = 0;
                 }
-                else // read failed
+            }
+        }
+        
+        if (!connection_open)
+        {
+            return false;
+        }
+        
+        if (begin == end) // nothing left so the buffer can be reused from the start
+        {
+            begin = end = 0;
+            
+            if (buffer.size() > s_receive_buffer_len)
+            {
+                vector<char>(s_receive_buffer_len).swap(buffer);
+            }
+        }
+        
+        return true;
+    }
+    
+    template<class ServerBackend>
+    typename ServerDispatcher<ServerBackend>::IoStatus ServerDispatcher<ServerBackend>::readSocket(Connection& in_connection)
+    {
+        auto& buffer = in_connection.m_receive_buffer;
+        
+        auto& begin = in_connection.m_receive_begin;
+        
+        auto& end = in_connection.m_receive_end;
+        
+        if (begin > 0) // move the partially received request to the front to make room
+        {
+            memmove(buffer.data(), buffer.data() + begin, end - begin);
+            
+            end -= begin;
+            
+            begin = 0;
+        }
+        
+        while (end < buffer.size())
+        {
+            ssize_t bytes_read = recv(in_connection.m_sockfd, buffer.data() + end, buffer.size() - end, 0);
+            
+            if (bytes_read > 0)
+            {
+                end += bytes_read;
+            }
+            else if (0 == bytes_read) // client closed connection
+            {
+                return IoStatus::Failed;
+            }
+            else if (EAGAIN == errno || EWOULDBLOCK == errno)
+            {
+                return IoStatus::WouldBlock;
+            }
+            else if (!(EINTR == errno))
+            {
+                if (!(ECONNRESET == errno || ENOENT == errno))
                 {
-                    break;
+#ifdef DEBUG
+                    // ignore errors related to client closing connection as these are errors on
+                    // the client-side
+                    perror("Error reading from socket file descriptor");
+#endif
                 }
+                
+                return IoStatus::Failed;
             }
-            while (transaction_in_progress);
+        }
+        
+        return IoStatus::Complete;
+    }
+    
+    template<class ServerBackend>
+    bool ServerDispatcher<ServerBackend>::parkConnection(Connection * in_p_connection)
+    {
+        assert(!(nullptr == in_p_connection));
+        
+        lock_guard<mutex> connection_grd(in_p_connection->m_mtx);
+        
+        // Note: The work item saw EAGAIN before acquiring m_mtx. If the notifier thread has
+        //       flagged the connection ready since then, the corresponding edge was consumed while
+        //       the connection was still scheduled, so it cannot be parked without missing it.
+        if (in_p_connection->m_ready)
+        {
+            in_p_connection->m_ready = false;
+            
+            return false;
+        }
+        
+        in_p_connection->m_scheduled = false;
+        
+        in_p_connection->m_last_activity = steady_clock::now();
+        
+        return true;
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::reclaimConnections(EventLoop& in_event_loop)
+    {
+        auto p_connection = in_event_loop.m_p_retired_connections.exchange(nullptr);
+        
+        while (!(nullptr == p_connection))
+        {
+            auto p_next_connection = p_connection->m_p_next_retired;
             
-            lock_guard<mutex> global_grd(g_mtx);
+            in_event_loop.m_notifier.remove(p_connection->m_sockfd);
             
 #ifdef DEBUG
-            std::cout << "closing socket descriptor " << in_sockfd << std::endl;
+            std::cout << "closing socket descriptor " + std::to_string(p_connection->m_sockfd) + "\n" << std::flush;
 #endif
             
-            if (close(in_sockfd) < 0)
+            if (close(p_connection->m_sockfd) < 0)
             {
 #ifdef DEBUG
                 perror("Error closing socket descriptor");
 #endif
             }
             
-            FD_CLR(in_sockfd, &m_rfds);
-        };
+            in_event_loop.m_connections.erase(p_connection);
+            
+            m_timer_wheel.cancel(p_connection->m_idle_timer_id);
+            
+            m_num_connections.fetch_sub(1);
+            
+            delete p_connection;
+            
+            p_connection = p_next_connection;
+        }
     }
     
     template<class ServerBackend>
-    void ServerDispatcher<ServerBackend>::initializeSocket()
+    void ServerDispatcher<ServerBackend>::retireConnection(Connection * in_p_connection)
     {
-        struct sockaddr_in serv_addr;
+        assert(!(nullptr == in_p_connection));
+        
+        auto& event_loop = in_p_connection->m_event_loop;
+        
+        in_p_connection->m_p_next_retired = event_loop.m_p_retired_connections.load();
+        
+        while (!event_loop.m_p_retired_connections.compare_exchange_weak(in_p_connection->m_p_next_retired, in_p_connection));
         
-        m_listenfd = socket(AF_INET, SOCK_STREAM, 0);
+        event_loop.m_notifier.wakeup();
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::retireIdleConnections(EventLoop& in_event_loop)
+    {
+        vector<std::pair<Connection *, TimerId>> idle_connections;
+        
+        if (unique_lock<mutex> idle_lck(in_event_loop.m_idle_mtx); idle_lck.owns_lock())
+        {
+            idle_connections.swap(in_event_loop.m_idle_connections);
+        }
         
-        FD_SET(m_listenfd, &m_rfds);
+        auto now = steady_clock::now();
         
-        if (m_listenfd < 0)
+        const std::chrono::milliseconds timeout = std::chrono::seconds(m_connection_timeout_seconds);
+        
+        for (auto [p_connection, idle_timer_id] : idle_connections)
         {
-            perror("Error opening socket");
+            // the connection may have been closed, and its address reused, since the timer expired
+            if (0 == in_event_loop.m_connections.count(p_connection) || !(idle_timer_id == p_connection->m_idle_timer_id))
+            {
+                continue;
+            }
             
-            exit(EXIT_FAILURE);
+            lock_guard<mutex> connection_grd(p_connection->m_mtx);
+            
+            auto idle_time = std::chrono::duration_cast<std::chrono::milliseconds>(now - p_connection->m_last_activity);
+            
+            if (!p_connection->m_scheduled && 0 == p_connection->m_requests_in_flight && idle_time + m_timer_wheel.getTick() >= timeout) // to within a tick
+            {
+                p_connection->m_scheduled = true; // prevent readiness from scheduling it again
+                
+                retireConnection(p_connection);
+            }
+            else
+            {
+                // a connection being processed is checked again a full timeout later
+                armIdleTimer(p_connection, p_connection->m_scheduled || p_connection->m_requests_in_flight > 0 ? timeout : timeout - idle_time);
+            }
         }
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::runEventLoop(EventLoop& in_event_loop)
+    {
+        EventNotifier::Event events[s_max_events];
         
-        bzero((char *) &serv_addr, sizeof(serv_addr));
+        in_event_loop.m_notifier.add(in_event_loop.m_listenfd, &in_event_loop.m_listenfd);
         
-        serv_addr.sin_family = AF_INET;
+        if (!(in_event_loop.m_unix_listenfd < 0))
+        {
+            in_event_loop.m_notifier.add(in_event_loop.m_unix_listenfd, &in_event_loop.m_unix_listenfd);
+        }
         
-        serv_addr.sin_addr.s_addr = inet_addr(m_ipv4_addr.c_str());
+        while (1)
+        {
+            // idle timers wake the loop when they expire so it waits without a timeout
+            int num_events = in_event_loop.m_notifier.wait(events, s_max_events);
+            
+            for (int i = 0; i < num_events; ++i)
+            {
+                // listening sockets are registered with the address of their descriptor as context
+                if (&in_event_loop.m_listenfd == events[i].m_p_context || &in_event_loop.m_unix_listenfd == events[i].m_p_context)
+                {
+                    acceptConnections(in_event_loop, *static_cast<int *>(events[i].m_p_context));
+                }
+                else
+                {
+                    scheduleConnection(static_cast<Connection *>(events[i].m_p_context));
+                }
+            }
+            
+            retireIdleConnections(in_event_loop);
+            
+            reclaimConnections(in_event_loop);
+        }
         
-        serv_addr.sin_port = htons(m_portno);
+        close(in_event_loop.m_listenfd);
         
-        if (bind(m_listenfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0)
+        if (!(in_event_loop.m_unix_listenfd < 0))
         {
-            perror("Error on binding");
+            close(in_event_loop.m_unix_listenfd);
             
-            exit(EXIT_FAILURE);
+            unlink(m_unix_path.c_str());
         }
+    }
+    
+    template<class ServerBackend>
+    void ServerDispatcher<ServerBackend>::scheduleConnection(Connection * in_p_connection)
+    {
+        assert(!(nullptr == in_p_connection));
         
-        listen(m_listenfd, m_backlog);
+        unique_lock<mutex> connection_lck(in_p_connection->m_mtx);
         
-        m_cli_len = sizeof(m_cli_addr);
+        if (in_p_connection->m_scheduled) // a worker owns the connection, let it know to try again
+        {
+            in_p_connection->m_ready = true;
+        }
+        else
+        {
+            in_p_connection->m_scheduled = true;
+            
+            in_p_connection->m_ready = false;
+            
+            connection_lck.unlock();
+            
+            m_thread_pool.submit([this, in_p_connection]() { m_processRequest(in_p_connection); });
+        }
     }
     
     template<class ServerBackend>
-    bool ServerDispatcher<ServerBackend>::readSocket(int in_sockfd, char * out_buffer, int in_buffer_len)
+    size_t ServerDispatcher<ServerBackend>::submitRequest(Connection& in_connection, const char * in_request, size_t in_request_header_len, size_t in_content_len)
     {
-        assert(!(nullptr == out_buffer));
+        assert(!(nullptr == in_request));
+        
+        size_t requests_in_flight;
         
-        if (ReadWriteHelper::readFileDescriptor(in_sockfd, out_buffer, in_buffer_len, m_connection_timeout_seconds, &m_fd_mtxs[in_sockfd], &m_fd_cvs[in_sockfd]) < 0)
         {
-            if (!(ECONNRESET == errno || ENOENT == errno || ETIMEDOUT == errno || 0 == errno))
-            {
-#ifdef DEBUG
-                // ignore errors related to client closing connection and client timeout as these are
-                // errors on the client-side
-                if (unique_lock<mutex> global_lck(g_mtx); global_lck.owns_lock())
-                {
-                    perror("Error reading from socket file descriptor");
-                }
-#endif
-            }
+            lock_guard<mutex> connection_grd(in_connection.m_mtx);
             
-            return false;
+            requests_in_flight = ++in_connection.m_requests_in_flight;
         }
         
-        return true;
+        auto p_connection = &in_connection;
+        
+        // the session is only written before the first request is processed so it is read in
+        // place, while the request is copied as the receive buffer is reused once it returns
+        m_thread_pool.submit([this, p_connection, request = string(in_request, in_request_header_len + in_content_len), in_request_header_len]()
+        {
+            bool transaction_in_progress = true; // each request ends only its own transaction
+            
+            Response server_response;
+            
+            m_up_backend->processRequest(p_connection->m_session, request.data(), request.data() + in_request_header_len, server_response, transaction_in_progress);
+            
+            completeRequest(p_connection, std::move(server_response));
+        });
+        
+        return requests_in_flight;
     }
 }
 
@@ -11,7 +11,12 @@
 
 using namespace EmersonClientServerFileSystem;
 
-Server::Server(const string& in_ipv4_address, int in_portno, const string& in_directory) : m_up_dispatcher(make_unique<ServerDispatcher<ServerBackend>>(in_ipv4_address, in_portno, Constants::server_backlog, Constants::max_sockfd, Constants::connection_timeout_seconds, make_unique<ServerBackend>(in_directory))) {}
+Server::Server(const string& in_ipv4_address, int in_portno, const string& in_directory, const string& in_unix_path) : m_timer_wheel(TimerWheel::milliseconds(Constants::timer_tick_milliseconds), Constants::timer_wheel_slots), m_up_dispatcher(make_unique<ServerDispatcher<ServerBackend>>(in_ipv4_address, in_portno, in_unix_path, Constants::server_backlog, Constants::max_connections, Constants::event_loops, Constants::worker_threads, Constants::connection_timeout_seconds, make_unique<ServerBackend>(in_directory, m_timer_wheel, Constants::backend_shards), m_timer_wheel)) {}
+
+Server::~Server()
+{
+    m_timer_wheel.stop();
+}
 
 void Server::start()
 {
@@ -16,6 +16,7 @@
 
 #include "server-backend.h"
 #include "server-dispatcher.h"
+#include "timer-wheel.h"
 
 namespace EmersonClientServerFileSystem
 {
@@ -32,13 +33,21 @@ namespace EmersonClientServerFileSystem
         template<class T>
         static constexpr auto make_unique = [](auto&&... ts) constexpr -> decltype(auto) { return std::make_unique<T>(std::forward<decltype(ts)>(ts)...);};
         
+        // runs the connection timeouts of the dispatcher and the transaction timeouts of the
+        // backend, so must be constructed before either
+        TimerWheel m_timer_wheel;
+        
         // unique_ptr as ServerDispatcher contains mutexes and condition_variables which are not
         // copyable/movable
         unique_ptr<ServerDispatcher<ServerBackend>> m_up_dispatcher;
         
     public:
         
-        Server(const string& in_ipv4_address, int in_portno, const string& in_directory);
+        // Note: An empty in_unix_path disables the Unix domain socket listener
+        Server(const string& in_ipv4_address, int in_portno, const string& in_directory, const string& in_unix_path = "");
+        
+        // stops m_timer_wheel before the dispatcher and backend its callbacks refer to are destroyed
+        ~Server();
         
         void start();
         
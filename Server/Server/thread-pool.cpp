@@ -0,0 +1,167 @@
+//
+//  thread-pool.cpp
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+
+#include "thread-pool.h"
+
+using namespace EmersonClientServerFileSystem;
+
+thread_local int ThreadPool::s_worker_index = -1;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public Member Functions                                                                        //
+// ↓                                                                                            ↓ //
+
+ThreadPool::ThreadPool(int in_num_threads)
+{
+    int num_threads = in_num_threads > 0 ? in_num_threads : static_cast<int>(thread::hardware_concurrency());
+    
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    
+    for (int i = 0; i < num_threads; ++i)
+    {
+        m_workers.emplace_back(std::make_unique<Worker>());
+    }
+    
+    // workers must all exist before any thread starts as threads steal from each other
+    for (int i = 0; i < num_threads; ++i)
+    {
+        m_threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    if (unique_lock<mutex> sleep_lck(m_sleep_mtx); sleep_lck.owns_lock())
+    {
+        m_stop.store(true);
+    }
+    
+    m_sleep_cv.notify_all();
+    
+    for (auto& worker_thread : m_threads)
+    {
+        worker_thread.join();
+    }
+}
+
+void ThreadPool::submit(Task&& in_task)
+{
+    int num_workers = static_cast<int>(m_workers.size());
+    
+    // tasks submitted by a worker stay with that worker unless stolen
+    int worker_index = 0 <= s_worker_index && s_worker_index < num_workers ? s_worker_index : static_cast<int>(m_next_worker++ % num_workers);
+    
+    auto& worker = *m_workers[worker_index];
+    
+    if (unique_lock<mutex> worker_lck(worker.m_mtx); worker_lck.owns_lock())
+    {
+        worker.m_tasks.push_back(std::move(in_task));
+    }
+    
+    ++m_num_pending_tasks;
+    
+    // Note: A worker increments m_num_sleeping_workers before checking m_num_pending_tasks with
+    //       m_sleep_mtx held, so either the worker sees the task just added or this thread sees
+    //       the sleeping worker and wakes it.
+    if (m_num_sleeping_workers > 0)
+    {
+        lock_guard<mutex> sleep_grd(m_sleep_mtx);
+        
+        m_sleep_cv.notify_one();
+    }
+}
+
+// ↑                                                                                            ↑ //
+// Public Member Functions                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Private Member Functions                                                                       //
+// ↓                                                                                            ↓ //
+
+void ThreadPool::run(int in_worker_index)
+{
+    s_worker_index = in_worker_index;
+    
+    Task task;
+    
+    while (1)
+    {
+        if (tryPop(in_worker_index, task) || trySteal(in_worker_index, task))
+        {
+            --m_num_pending_tasks;
+            
+            task();
+            
+            task = nullptr;
+        }
+        else
+        {
+            unique_lock<mutex> sleep_lck(m_sleep_mtx);
+            
+            ++m_num_sleeping_workers;
+            
+            m_sleep_cv.wait(sleep_lck, [this]() { return m_num_pending_tasks > 0 || m_stop; });
+            
+            --m_num_sleeping_workers;
+            
+            if (m_stop)
+            {
+                return;
+            }
+        }
+    }
+}
+
+bool ThreadPool::tryPop(int in_worker_index, Task& out_task)
+{
+    auto& worker = *m_workers[in_worker_index];
+    
+    lock_guard<mutex> worker_grd(worker.m_mtx);
+    
+    if (worker.m_tasks.empty())
+    {
+        return false;
+    }
+    
+    out_task = std::move(worker.m_tasks.back());
+    
+    worker.m_tasks.pop_back();
+    
+    return true;
+}
+
+bool ThreadPool::trySteal(int in_worker_index, Task& out_task)
+{
+    int num_workers = static_cast<int>(m_workers.size());
+    
+    for (int i = 1; i < num_workers; ++i)
+    {
+        auto& victim = *m_workers[(in_worker_index + i) % num_workers];
+        
+        lock_guard<mutex> victim_grd(victim.m_mtx);
+        
+        if (!victim.m_tasks.empty())
+        {
+            out_task = std::move(victim.m_tasks.front());
+            
+            victim.m_tasks.pop_front();
+            
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// ↑                                                                                            ↑ //
+// Private Member Functions                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,119 @@
+//
+//  thread-pool.h
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The ThreadPool class runs submitted tasks on a fixed number of worker threads. Each worker     //
+// owns a deque of tasks which it pops from the back (most recently submitted first, so a task    //
+// submitted by a worker tends to run on the same core while its data is still in cache) and      //
+// which idle workers steal from the front. Tasks submitted from outside the pool are distributed //
+// across the workers round robin.                                                                //
+//                                                                                                //
+// Note: Each deque is protected by its own mutex so submitting and stealing only ever contend    //
+//       with the owner of a single deque. Idle workers sleep on a condition variable which is    //
+//       only signalled when a worker is known to be sleeping.                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef thread_pool_h
+#define thread_pool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace EmersonClientServerFileSystem
+{
+    class ThreadPool
+    {
+        
+    public:
+        
+        using Task = std::function<void()>;
+        
+    private:
+        
+        using condition_variable = std::condition_variable;
+        
+        using mutex = std::mutex;
+        
+        using thread = std::thread;
+        
+        template<class T>
+        using atomic = std::atomic<T>;
+        
+        template<class T>
+        using deque = std::deque<T>;
+        
+        template<class T>
+        using lock_guard = std::lock_guard<T>;
+        
+        template<class T>
+        using unique_lock = std::unique_lock<T>;
+        
+        template<class T>
+        using unique_ptr = std::unique_ptr<T>;
+        
+        template<class T>
+        using vector = std::vector<T>;
+        
+        struct Worker
+        {
+            mutex m_mtx;
+            deque<Task> m_tasks;
+        };
+        
+        // index of the worker running on the current thread, -1 if the current thread does not
+        // belong to a ThreadPool
+        static thread_local int s_worker_index;
+        
+        vector<unique_ptr<Worker>> m_workers;
+        
+        vector<thread> m_threads;
+        
+        atomic<unsigned> m_next_worker = ATOMIC_VAR_INIT(0);
+        
+        atomic<int> m_num_pending_tasks = ATOMIC_VAR_INIT(0);
+        
+        atomic<int> m_num_sleeping_workers = ATOMIC_VAR_INIT(0);
+        
+        atomic<bool> m_stop = ATOMIC_VAR_INIT(false);
+        
+        mutex m_sleep_mtx;
+        
+        condition_variable m_sleep_cv;
+        
+        // runs tasks on the calling thread until the pool is destroyed
+        void run(int in_worker_index);
+        
+        // pops the most recently submitted task from the given worker's own deque
+        bool tryPop(int in_worker_index, Task& out_task);
+        
+        // steals the least recently submitted task from any worker other than the given worker
+        bool trySteal(int in_worker_index, Task& out_task);
+        
+    public:
+        
+        // ctor in_num_threads defaults to the number of cores
+        ThreadPool(int in_num_threads = 0);
+        
+        ~ThreadPool();
+        
+        ThreadPool(const ThreadPool&) = delete;
+        
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        
+        // queues in_task to be run by one of the workers
+        void submit(Task&& in_task);
+        
+    };
+}
+
+#endif /* thread_pool_h */
@@ -0,0 +1,272 @@
+//
+//  timer-wheel.cpp
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+
+#include <algorithm>
+#include <cassert>
+
+#include "timer-wheel.h"
+
+using namespace EmersonClientServerFileSystem;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public Member Functions                                                                        //
+// ↓                                                                                            ↓ //
+
+TimerWheel::TimerWheel(milliseconds in_tick, size_t in_num_slots) : m_tick(in_tick.count() > 0 ? in_tick : milliseconds(1)), m_start(steady_clock::now()), m_slots(in_num_slots > 0 ? in_num_slots : 1, s_nil)
+{
+    m_thread = thread(&TimerWheel::run, this);
+}
+
+TimerWheel::~TimerWheel()
+{
+    stop();
+}
+
+TimerWheel::milliseconds TimerWheel::getTick() const
+{
+    return m_tick;
+}
+
+TimerWheel::TimerId TimerWheel::arm(milliseconds in_delay, Callback&& in_callback)
+{
+    unique_lock<mutex> timer_lck(m_mtx);
+    
+    uint32_t index = m_free_timers;
+    
+    if (s_nil == index)
+    {
+        index = static_cast<uint32_t>(m_timers.size());
+        
+        m_timers.emplace_back();
+    }
+    else
+    {
+        m_free_timers = m_timers[index].m_next;
+    }
+    
+    auto& timer = m_timers[index];
+    
+    timer.m_callback = std::move(in_callback);
+    
+    link(index, getExpiryTick(in_delay));
+    
+    // the thread sleeps without a deadline while no timer is armed
+    if (1 == ++m_num_armed_timers)
+    {
+        m_cv.notify_one();
+    }
+    
+    return TimerId(timer.m_generation) << 32 | index;
+}
+
+bool TimerWheel::rearm(TimerId in_timer_id, milliseconds in_delay)
+{
+    unique_lock<mutex> timer_lck(m_mtx);
+    
+    if (nullptr == findTimer(in_timer_id))
+    {
+        return false;
+    }
+    
+    auto index = static_cast<uint32_t>(in_timer_id);
+    
+    unlink(index);
+    
+    link(index, getExpiryTick(in_delay));
+    
+    return true;
+}
+
+bool TimerWheel::cancel(TimerId in_timer_id)
+{
+    unique_lock<mutex> timer_lck(m_mtx);
+    
+    if (nullptr == findTimer(in_timer_id))
+    {
+        return false;
+    }
+    
+    release(static_cast<uint32_t>(in_timer_id));
+    
+    return true;
+}
+
+void TimerWheel::stop()
+{
+    if (unique_lock<mutex> timer_lck(m_mtx); timer_lck.owns_lock())
+    {
+        m_stop = true;
+    }
+    
+    m_cv.notify_one();
+    
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+// ↑                                                                                            ↑ //
+// Public Member Functions                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Private Member Functions                                                                       //
+// ↓                                                                                            ↓ //
+
+TimerWheel::Timer * TimerWheel::findTimer(TimerId in_timer_id)
+{
+    auto index = static_cast<uint32_t>(in_timer_id);
+    
+    if (index < m_timers.size() && m_timers[index].m_armed && m_timers[index].m_generation == static_cast<uint32_t>(in_timer_id >> 32))
+    {
+        return &m_timers[index];
+    }
+    
+    return nullptr;
+}
+
+uint64_t TimerWheel::getExpiryTick(milliseconds in_delay) const
+{
+    auto ticks = (steady_clock::now() - m_start + in_delay) / m_tick;
+    
+    return ticks > 0 && static_cast<uint64_t>(ticks) > m_current_tick ? static_cast<uint64_t>(ticks) : m_current_tick + 1;
+}
+
+void TimerWheel::link(uint32_t in_index, uint64_t in_expiry_tick)
+{
+    auto& timer = m_timers[in_index];
+    
+    auto& head = m_slots[in_expiry_tick % m_slots.size()];
+    
+    timer.m_expiry_tick = in_expiry_tick;
+    
+    timer.m_prev = s_nil;
+    
+    timer.m_next = head;
+    
+    if (!(s_nil == head))
+    {
+        m_timers[head].m_prev = in_index;
+    }
+    
+    head = in_index;
+    
+    timer.m_armed = true;
+}
+
+void TimerWheel::release(uint32_t in_index)
+{
+    unlink(in_index);
+    
+    auto& timer = m_timers[in_index];
+    
+    timer.m_callback = nullptr;
+    
+    ++timer.m_generation;
+    
+    if (0 == timer.m_generation) // s_no_timer must never be a valid id
+    {
+        timer.m_generation = 1;
+    }
+    
+    timer.m_next = m_free_timers;
+    
+    m_free_timers = in_index;
+    
+    --m_num_armed_timers;
+}
+
+void TimerWheel::unlink(uint32_t in_index)
+{
+    auto& timer = m_timers[in_index];
+    
+    assert(timer.m_armed);
+    
+    if (s_nil == timer.m_prev)
+    {
+        m_slots[timer.m_expiry_tick % m_slots.size()] = timer.m_next;
+    }
+    else
+    {
+        m_timers[timer.m_prev].m_next = timer.m_next;
+    }
+    
+    if (!(s_nil == timer.m_next))
+    {
+        m_timers[timer.m_next].m_prev = timer.m_prev;
+    }
+    
+    timer.m_armed = false;
+}
+
+void TimerWheel::run()
+{
+    vector<std::pair<TimerId, Callback>> expired_timers;
+    
+    unique_lock<mutex> timer_lck(m_mtx);
+    
+    while (!m_stop)
+    {
+        if (0 == m_num_armed_timers)
+        {
+            m_cv.wait(timer_lck, [this]() { return m_num_armed_timers > 0 || m_stop; });
+            
+            continue;
+        }
+        
+        auto next_tick_time = m_start + (m_current_tick + 1) * m_tick;
+        
+        if (steady_clock::now() < next_tick_time)
+        {
+            m_cv.wait_until(timer_lck, next_tick_time);
+            
+            continue;
+        }
+        
+        auto now_tick = static_cast<uint64_t>((steady_clock::now() - m_start) / m_tick);
+        
+        // Note: Every tick missed while callbacks ran is visited in turn, though no more than one
+        //       turn of the wheel is needed to visit every slot.
+        for (uint64_t tick = std::max(m_current_tick + 1, now_tick >= m_slots.size() ? now_tick - m_slots.size() + 1 : 0); tick <= now_tick; ++tick)
+        {
+            for (uint32_t index = m_slots[tick % m_slots.size()]; !(s_nil == index);)
+            {
+                auto& timer = m_timers[index];
+                
+                uint32_t next_index = timer.m_next;
+                
+                if (timer.m_expiry_tick <= now_tick)
+                {
+                    expired_timers.emplace_back(TimerId(timer.m_generation) << 32 | index, std::move(timer.m_callback));
+                    
+                    release(index);
+                }
+                
+                index = next_index;
+            }
+        }
+        
+        m_current_tick = now_tick;
+        
+        timer_lck.unlock();
+        
+        for (auto& [timer_id, callback] : expired_timers)
+        {
+            callback(timer_id);
+        }
+        
+        expired_timers.clear();
+        
+        timer_lck.lock();
+    }
+}
+
+// ↑                                                                                            ↑ //
+// Private Member Functions                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,162 @@
+//
+//  timer-wheel.h
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The TimerWheel class runs callbacks once their timers expire, all on a single thread. Timers   //
+// are kept in a hashed timing wheel, a ring of slots each covering one tick, and a timer is      //
+// linked into the slot of the tick it expires on. Arming, rearming and cancelling a timer        //
+// therefore only link or unlink it, whatever the number of timers, and each tick only visits the //
+// timers in one slot.                                                                            //
+//                                                                                                //
+// Note: A timer further ahead than one turn of the wheel shares its slot with timers expiring    //
+//       sooner and is passed over until the turn it expires on.                                  //
+//                                                                                                //
+// Note: Callbacks run on the thread of the TimerWheel without its mutex held so they may arm,    //
+//       rearm or cancel timers, but they should not block for long as they delay every timer     //
+//       expiring after them. A timer is released before its callback runs, so cancelling it from //
+//       another thread at that point has no effect. Callbacks are passed the id of their timer   //
+//       for owners that need to tell whether the timer that fired is still theirs.               //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef timer_wheel_h
+#define timer_wheel_h
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace EmersonClientServerFileSystem
+{
+    class TimerWheel
+    {
+        
+    public:
+        
+        // Note: A TimerId holds the generation of its timer in the upper 32 bits and the index of
+        //       the timer in the lower 32 bits. Generations start at 1, so s_no_timer is never the
+        //       id of a timer, and are incremented whenever a timer is released so an id is never
+        //       mistaken for a later timer reusing the same index.
+        using TimerId = uint64_t;
+        
+        using Callback = std::function<void(TimerId)>;
+        
+        using milliseconds = std::chrono::milliseconds;
+        
+        static constexpr TimerId s_no_timer = 0;
+        
+    private:
+        
+        using condition_variable = std::condition_variable;
+        
+        using mutex = std::mutex;
+        
+        using steady_clock = std::chrono::steady_clock;
+        
+        using thread = std::thread;
+        
+        template<class T>
+        using unique_lock = std::unique_lock<T>;
+        
+        template<class T>
+        using vector = std::vector<T>;
+        
+        static constexpr uint32_t s_nil = UINT32_MAX;
+        
+        // Note: m_prev and m_next link the timer into the list of its slot while it is armed and
+        //       m_next links it into the free list otherwise.
+        struct Timer
+        {
+            Callback m_callback;
+            uint64_t m_expiry_tick = 0;
+            uint32_t m_generation = 1;
+            uint32_t m_prev = s_nil;
+            uint32_t m_next = s_nil;
+            bool m_armed = false;
+        };
+        
+        const milliseconds m_tick;
+        
+        const steady_clock::time_point m_start;
+        
+        vector<uint32_t> m_slots; // index of the first timer in each slot
+        
+        vector<Timer> m_timers;
+        
+        uint32_t m_free_timers = s_nil;
+        
+        size_t m_num_armed_timers = 0;
+        
+        uint64_t m_current_tick = 0; // every tick up to and including it has expired its timers
+        
+        bool m_stop = false;
+        
+        mutex m_mtx;
+        
+        condition_variable m_cv;
+        
+        thread m_thread;
+        
+        // Note: m_mtx must be acquired before invocation of any of the following.
+        
+        // returns the armed timer in_timer_id refers to, or nullptr if it has since expired or
+        // been cancelled
+        Timer * findTimer(TimerId in_timer_id);
+        
+        // returns the last tick at most in_delay from now, and never one that has expired
+        uint64_t getExpiryTick(milliseconds in_delay) const;
+        
+        void link(uint32_t in_index, uint64_t in_expiry_tick);
+        
+        // unlinks the timer from its slot and returns it to the free list
+        void release(uint32_t in_index);
+        
+        void unlink(uint32_t in_index);
+        
+        // runs the callbacks of expired timers on the calling thread until stop is called
+        void run();
+        
+    public:
+        
+        // Note: Delays are rounded down to whole ticks, so a timer may expire up to one tick
+        //       early. Owners that need a deadline to have passed check it to within getTick().
+        //
+        // ctor in_tick is the granularity of every delay
+        TimerWheel(milliseconds in_tick, size_t in_num_slots);
+        
+        ~TimerWheel();
+        
+        TimerWheel(const TimerWheel&) = delete;
+        
+        TimerWheel& operator=(const TimerWheel&) = delete;
+        
+        milliseconds getTick() const;
+        
+        // returns the id of a new timer running in_callback once in_delay has elapsed
+        TimerId arm(milliseconds in_delay, Callback&& in_callback);
+        
+        // returns false if the timer has already expired or been cancelled, otherwise moves its
+        // expiry to in_delay from now
+        bool rearm(TimerId in_timer_id, milliseconds in_delay);
+        
+        // returns false if the timer has already expired or been cancelled, otherwise releases it
+        // without running its callback
+        bool cancel(TimerId in_timer_id);
+        
+        // Note: Timers armed afterwards never expire.
+        //
+        // waits for the running callback, if any, to return and stops the thread of the TimerWheel
+        void stop();
+        
+    };
+}
+
+#endif /* timer_wheel_h */
@@ -0,0 +1,141 @@
+//
+//  transaction-id-allocator.cpp
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+
+#include <cassert>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+
+#include "exceptions.h"
+#include "file.h"
+#include "transaction-id-allocator.h"
+
+using namespace EmersonClientServerFileSystem;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Public Member Functions                                                                        //
+// ↓                                                                                            ↓ //
+
+TransactionIdAllocator::TransactionIdAllocator(const string& in_epoch_file_path) : m_epoch_file_path(in_epoch_file_path)
+{
+    uint64_t epoch = loadEpoch() + 1;
+    
+    if (!persistEpoch(epoch)) // ids could repeat those of an earlier run, so the server must not start
+    {
+        perror("Error writing epoch file");
+        
+        exit(EXIT_FAILURE);
+    }
+    
+    for (auto& counter : m_counters)
+    {
+        counter.m_next.store(epoch << s_seq_bits, std::memory_order_relaxed);
+    }
+}
+
+size_t TransactionIdAllocator::getShardIndex(TxnId in_txn_id)
+{
+    return static_cast<uint32_t>(in_txn_id) & (s_max_shards - 1);
+}
+
+TransactionIdAllocator::TxnId TransactionIdAllocator::allocate(size_t in_shard_index)
+{
+    assert(in_shard_index < s_max_shards);
+    
+    uint64_t next = m_counters[in_shard_index].m_next.fetch_add(1, std::memory_order_relaxed);
+    
+    // Note: The first id allocated in an epoch records it before it is returned, and any id
+    //       allocated in the same epoch meanwhile waits for the record in persistEpoch. An id
+    //       from an epoch that could not be recorded could repeat after a restart, so it is
+    //       never handed out, and every later id of that epoch tries to record it again.
+    if (uint64_t epoch = next >> s_seq_bits; epoch > m_persisted_epoch.load(std::memory_order_acquire) && !persistEpoch(epoch))
+    {
+#ifdef DEBUG
+        perror("Error writing epoch file");
+#endif
+        throw Exception::ErrorAllocatingTransactionId();
+    }
+    
+    uint64_t id_counter = next & ((uint64_t(1) << (s_seq_bits + s_epoch_bits)) - 1);
+    
+    return static_cast<TxnId>(id_counter << s_shard_bits | in_shard_index);
+}
+
+// ↑                                                                                            ↑ //
+// Public Member Functions                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Private Member Functions                                                                       //
+// ↓                                                                                            ↓ //
+
+uint64_t TransactionIdAllocator::loadEpoch() const
+{
+    uint64_t epoch = 0;
+    
+    if (File::fileExists(m_epoch_file_path))
+    {
+        try
+        {
+            string contents = File(m_epoch_file_path, O_RDONLY).read();
+            
+            std::from_chars(contents.data(), contents.data() + contents.length(), epoch);
+        }
+        catch (Exception::ErrorOpeningFile)
+        {
+            perror("Error opening epoch file");
+            
+            exit(EXIT_FAILURE);
+        }
+        catch (Exception::ErrorReadingFromFile)
+        {
+            perror("Error reading epoch file");
+            
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    return epoch;
+}
+
+bool TransactionIdAllocator::persistEpoch(uint64_t in_epoch)
+{
+    lock_guard<mutex> epoch_grd(m_epoch_mtx);
+    
+    if (in_epoch > m_persisted_epoch.load(std::memory_order_relaxed))
+    {
+        char buffer[21];
+        
+        snprintf(buffer, sizeof(buffer), "%020llu", static_cast<unsigned long long>(in_epoch));
+        
+        string entry(buffer);
+        
+        try
+        {
+            File(m_epoch_file_path, O_CREAT | O_WRONLY).writeAndSync({&entry});
+        }
+        catch (Exception::ErrorOpeningFile)
+        {
+            return false;
+        }
+        catch (Exception::ErrorWritingToFile)
+        {
+            return false;
+        }
+        
+        m_persisted_epoch.store(in_epoch, std::memory_order_release);
+    }
+    
+    return true;
+}
+
+// ↑                                                                                            ↑ //
+// Private Member Functions                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,113 @@
+//
+//  transaction-id-allocator.h
+//  Server
+//
+//  Created by Emerson Dolinski.
+//  Copyright © 2019 Emerson Dolinski. All rights reserved.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// The TransactionIdAllocator class hands out transaction ids without locking. An id is made up   //
+// of an epoch, a sequence number and the index of the shard it belongs to, from the highest bits //
+// to the lowest:                                                                                 //
+//                                                                                                //
+//     0 | EPOCH (8 bits) | SEQUENCE (17 bits) | SHARD (6 bits)                                   //
+//                                                                                                //
+// Each shard counts through the sequence numbers of an epoch with its own atomic counter, so     //
+// allocating an id is a single fetch_add and two shards never allocate the same id. A shard that //
+// runs out of sequence numbers moves on to the next epoch. The highest epoch any shard has       //
+// reached is written to the epoch file, and every shard starts a run in the epoch after it, so   //
+// ids stay unique across restarts.                                                               //
+//                                                                                                //
+// Note: Ids only wrap around once 256 epochs have been used, by restarts or by 2^17 ids being    //
+//       allocated in one shard. An id from before the wrap may still be open or in the commit    //
+//       set of its shard, so ServerBackend skips any id it finds in use.                         //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef transaction_id_allocator_h
+#define transaction_id_allocator_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace EmersonClientServerFileSystem
+{
+    class TransactionIdAllocator
+    {
+        
+    public:
+        
+        using TxnId = int;
+        
+        static constexpr int s_shard_bits = 6;
+        
+        static constexpr int s_seq_bits = 17;
+        
+        static constexpr int s_epoch_bits = 8;
+        
+        static constexpr size_t s_max_shards = size_t(1) << s_shard_bits;
+        
+        static_assert(31 == s_shard_bits + s_seq_bits + s_epoch_bits, "ids must be non-negative ints");
+        
+    private:
+        
+        using mutex = std::mutex;
+        
+        using string = std::string;
+        
+        template<class T>
+        using atomic = std::atomic<T>;
+        
+        template<class T>
+        using lock_guard = std::lock_guard<T>;
+        
+        // Note: Counters are aligned to separate cache lines so threads allocating from different
+        //       shards do not contend on the same line.
+        //
+        // the epoch in the upper bits and the next sequence number in the lower s_seq_bits bits
+        struct alignas(64) Counter
+        {
+            atomic<uint64_t> m_next{0};
+        };
+        
+        const string m_epoch_file_path;
+        
+        Counter m_counters[s_max_shards];
+        
+        atomic<uint64_t> m_persisted_epoch{0};
+        
+        mutex m_epoch_mtx;
+        
+        // returns the epoch recorded in the epoch file, or 0 if there is none
+        uint64_t loadEpoch() const;
+        
+        // Note: The epoch is written over the previous one at a fixed width so the file is never
+        //       left empty.
+        //
+        // records in_epoch in the epoch file unless a higher epoch has already been recorded,
+        // returning once it is on disk, and returns false if it could not be recorded
+        bool persistEpoch(uint64_t in_epoch);
+        
+    public:
+        
+        // ctor starts every shard in the epoch after the one recorded in in_epoch_file_path
+        TransactionIdAllocator(const string& in_epoch_file_path);
+        
+        TransactionIdAllocator(const TransactionIdAllocator&) = delete;
+        
+        TransactionIdAllocator& operator=(const TransactionIdAllocator&) = delete;
+        
+        // returns the index of the shard in_txn_id was allocated for
+        static size_t getShardIndex(TxnId in_txn_id);
+        
+        // returns a new id for the shard with index in_shard_index, which must be less than
+        // s_max_shards, throwing Exception::ErrorAllocatingTransactionId if the epoch of the id
+        // could not be recorded
+        TxnId allocate(size_t in_shard_index);
+        
+    };
+}
+
+#endif /* transaction_id_allocator_h */